@@ -0,0 +1,139 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+#include "sensors/traffic_view.h"
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+// collision and proximity queries between all cars of a TrafficView.
+// A sweep and prune broad phase along x finds pairs whose bounding boxes overlap, an
+// oriented box test on the car footprints and a height test decide the actual collisions.
+struct CollisionWorld
+{
+
+	std::vector<Box> boxes;
+	// car indices sorted by the boxes' x_min, kept between updates since the order barely changes
+	std::vector<size_t> sweepOrder;
+	// car indices sorted by center x for neighbor searches
+	std::vector<size_t> centerOrder;
+
+	void update(const TrafficView& cars)
+	{
+		size_t n = cars.size();
+		boxes.resize(n);
+		for(size_t i = 0; i < n; i++)
+			boxes[i] = cars.box(i);
+
+		if(sweepOrder.size() != n)
+		{
+			sweepOrder.resize(n);
+			centerOrder.resize(n);
+			for(size_t i = 0; i < n; i++)
+				sweepOrder[i] = centerOrder[i] = i;
+		}
+		// insertion sort is close to linear on the nearly sorted order from the last frame
+		insertionSort(sweepOrder, [this](size_t a, size_t b) { return boxes[a].x_min < boxes[b].x_min; });
+		insertionSort(centerOrder, [&cars](size_t a, size_t b) { return cars.x[a] < cars.x[b]; });
+	}
+
+	template <typename Less>
+	static void insertionSort(std::vector<size_t>& order, Less less)
+	{
+		for(size_t i = 1; i < order.size(); i++)
+		{
+			size_t value = order[i];
+			size_t j = i;
+			while(j > 0 && less(value, order[j-1]))
+			{
+				order[j] = order[j-1];
+				j--;
+			}
+			order[j] = value;
+		}
+	}
+
+	// pairs of cars whose axis aligned bounding boxes overlap, lower index first
+	std::vector<std::pair<size_t, size_t> > candidatePairs() const
+	{
+		std::vector<std::pair<size_t, size_t> > pairs;
+		for(size_t i = 0; i < sweepOrder.size(); i++)
+		{
+			const Box& a = boxes[sweepOrder[i]];
+			for(size_t j = i+1; j < sweepOrder.size(); j++)
+			{
+				const Box& b = boxes[sweepOrder[j]];
+				// every later box starts further along x
+				if(b.x_min > a.x_max)
+					break;
+				if(b.y_min <= a.y_max && b.y_max >= a.y_min && b.z_min <= a.z_max && b.z_max >= a.z_min)
+					pairs.push_back(std::make_pair(std::min(sweepOrder[i], sweepOrder[j]), std::max(sweepOrder[i], sweepOrder[j])));
+			}
+		}
+		return pairs;
+	}
+
+	// separating axis test between the rotated footprints of cars a and b
+	static bool footprintsOverlap(const TrafficView& cars, size_t a, size_t b)
+	{
+		double ca = cars.cosNegTheta[a], sa = -cars.sinNegTheta[a];
+		double cb = cars.cosNegTheta[b], sb = -cars.sinNegTheta[b];
+		double axes[4][2] = {{ca, sa}, {-sa, ca}, {cb, sb}, {-sb, cb}};
+		double dx = cars.x[b] - cars.x[a];
+		double dy = cars.y[b] - cars.y[a];
+		for(int k = 0; k < 4; k++)
+		{
+			double ax = axes[k][0], ay = axes[k][1];
+			// projected half extents of both footprints on the axis
+			double ra = fabs(ca*ax + sa*ay)*cars.length[a]/2 + fabs(-sa*ax + ca*ay)*cars.width[a]/2;
+			double rb = fabs(cb*ax + sb*ay)*cars.length[b]/2 + fabs(-sb*ax + cb*ay)*cars.width[b]/2;
+			if(fabs(dx*ax + dy*ay) > ra + rb)
+				return false;
+		}
+		return true;
+	}
+
+	// every pair of colliding cars, lower index first
+	std::vector<std::pair<size_t, size_t> > collisions(const TrafficView& cars) const
+	{
+		std::vector<std::pair<size_t, size_t> > hits;
+		for(const std::pair<size_t, size_t>& pair : candidatePairs())
+		{
+			// the broad phase already checked the heights
+			if(footprintsOverlap(cars, pair.first, pair.second))
+				hits.push_back(pair);
+		}
+		return hits;
+	}
+
+	// closest other car to every car by center distance on the xy plane, -1 if there is none
+	void nearestNeighbors(const TrafficView& cars, std::vector<int>& nearest, std::vector<double>& distance) const
+	{
+		size_t n = centerOrder.size();
+		nearest.assign(n, -1);
+		distance.assign(n, std::numeric_limits<double>::infinity());
+		for(size_t i = 0; i < n; i++)
+		{
+			size_t car = centerOrder[i];
+			double best = std::numeric_limits<double>::infinity();
+			// walk outwards along x until the x gap alone is further than the best so far
+			for(size_t j = i+1; j < n && cars.x[centerOrder[j]] - cars.x[car] < best; j++)
+				consider(cars, car, centerOrder[j], best, nearest[car]);
+			for(size_t j = i; j > 0 && cars.x[car] - cars.x[centerOrder[j-1]] < best; j--)
+				consider(cars, car, centerOrder[j-1], best, nearest[car]);
+			distance[car] = best;
+		}
+	}
+
+	static void consider(const TrafficView& cars, size_t car, size_t other, double& best, int& nearest)
+	{
+		double d = hypot(cars.x[other]-cars.x[car], cars.y[other]-cars.y[car]);
+		if(d < best)
+		{
+			best = d;
+			nearest = other;
+		}
+	}
+
+};
+
+#endif
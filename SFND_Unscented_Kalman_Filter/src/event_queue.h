@@ -0,0 +1,73 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+#include <cstddef>
+#include <queue>
+#include <vector>
+
+// time ordered queue of events, earliest first. Events with the same time come out
+// in the order they were pushed.
+template <typename T>
+struct EventQueue
+{
+
+	struct Event
+	{
+		long long time_us;
+		unsigned long long sequence;
+		T payload;
+
+		Event(long long setTime, unsigned long long setSequence, const T& setPayload)
+			: time_us(setTime), sequence(setSequence), payload(setPayload)
+		{}
+	};
+
+	struct Later
+	{
+		bool operator()(const Event& a, const Event& b) const
+		{
+			return a.time_us > b.time_us || (a.time_us == b.time_us && a.sequence > b.sequence);
+		}
+	};
+
+	std::priority_queue<Event, std::vector<Event>, Later> heap;
+	unsigned long long pushed;
+
+	EventQueue()
+		: pushed(0)
+	{}
+
+	void push(long long time_us, const T& payload)
+	{
+		heap.push(Event(time_us, pushed++, payload));
+	}
+
+	bool empty() const
+	{
+		return heap.empty();
+	}
+
+	size_t size() const
+	{
+		return heap.size();
+	}
+
+	const Event& top() const
+	{
+		return heap.top();
+	}
+
+	Event pop()
+	{
+		Event event = heap.top();
+		heap.pop();
+		return event;
+	}
+
+	void clear()
+	{
+		heap = std::priority_queue<Event, std::vector<Event>, Later>();
+	}
+
+};
+
+#endif
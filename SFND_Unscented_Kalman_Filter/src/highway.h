@@ -2,20 +2,56 @@
 // Handle logic for creating traffic on highway and animating it
 
 #include "render/render.h"
-#include "sensors/lidar.h"
+#include "render/hud.h"
+#include "sensors/lidar_rig.h"
 #include "tools.h"
+#include "traffic_kinematics.h"
+#include "collision.h"
+#include "sensors/visibility.h"
+#include "sensors/occupancy_grid.h"
+#include "track_scheduler.h"
+#include "tracker_workers.h"
+#include "track_pool.h"
 
 class Highway
 {
 public:
 
 	std::vector<Car> traffic;
+	// car poses the sensors see, refreshed every frame after the cars move
+	TrafficView trafficView;
+	// integrates all cars' motion together
+	TrafficKinematics kinematics;
+	// broad and narrow phase collision checks between the cars
+	CollisionWorld collisionWorld;
 	Car egoCar;
 	Tools tools;
 	bool pass = true;
 	std::vector<double> rmseThreshold = {0.30,0.16,0.95,0.70};
 	std::vector<double> rmseFailLog = {0.0,0.0,0.0,0.0};
-	Lidar* lidar;
+	// accuracy overlay, its text stays in the viewer across frames
+	Hud hud;
+	int rmseLines[4];
+	int rmseFailLine;
+	int rmseFailLines[4];
+	LidarRig lidarRig;
+	// poles and guardrails along the road in the world frame
+	StaticScene staticScene;
+	// line of sight from the radar to the cars, and what it found on the last radar update
+	VisibilityQuery radarVisibility;
+	std::vector<uint8_t> radarVisible;
+	// free space around the ego car mapped from the lidar scans
+	OccupancyGrid occupancy;
+	// which tracks each sensor tick updates when the updates run over budget
+	TrackScheduler lidarSchedule;
+	TrackScheduler radarSchedule;
+	// the filter states of the tracked cars, each tracked car holds the index of its track
+	TrackPool trackPool;
+	// threads running the UKF updates of a tick and the measurements they update with, by track
+	TrackerWorkers trackerWorkers;
+	std::vector<MeasurementPackage> measurements;
+	// time the traffic was last moved to, events sharing it find the cars already there
+	long long trafficTime_us = 0;
 	
 	// Parameters 
 	// --------------------------------
@@ -25,6 +61,51 @@ public:
 	bool visualize_lidar = false;
 	bool visualize_radar = true;
 	bool visualize_pcd = false;
+	// Simulate the lidar point cloud at scanRate and render it, the ray tables are only built if this is set
+	bool scan_lidar = false;
+	// Map the lidar scans into the occupancy grid, needs scan_lidar
+	bool map_occupancy = false;
+	// Sweep the lidars over a whole scan period (1/scanRate) while the cars move, like a spinning sensor,
+	// and deskew the fused cloud with the tracks' UKF estimates, needs scan_lidar
+	bool rolling_scan = false;
+	// Lidars mounted on the ego car, scanned together into one cloud. The profile is vlp16, hdl32, hdl64
+	// or vls128, vlp16 scans the lightest cloud
+	std::vector<LidarMount> lidarMounts = {LidarMount(Vect3(0, 0, 3.0), 0, "hdl64")};
+	// Sensor rates in Hz, each sensor fires on its own schedule
+	double lidarRate = 30;
+	double radarRate = 30;
+	double scanRate = 10;
+	// Drop radar detections of cars hidden behind other cars or objects next to the road
+	bool radar_occlusion = false;
+	// Height of the radar above the road in meters
+	double radarHeight = 0.5;
+	// Skip updates of far, steady tracks when a sensor tick's updates take longer than trackBudget microseconds
+	bool schedule_tracks = false;
+	double trackBudget = 1000;
+	// Run the UKF updates on this many threads, 0 runs them on the simulation thread. The threads are
+	// pinned round robin to tracker_cores and run SCHED_FIFO at tracker_priority if above 0, the track
+	// pool is locked into RAM if lock_tracker_memory is set, each where the OS permits it
+	int tracker_threads = 0;
+	std::vector<int> tracker_cores = {};
+	int tracker_priority = 0;
+	bool lock_tracker_memory = false;
+	// Report cars colliding with each other
+	bool check_collisions = false;
+	// Speed of the ego car in m/s, moves the poles past the ego car
+	double egoVelocity = 25;
+	// Length of road in meters the lidars see poles and guardrails along
+	double roadLength = 1000;
+	// Only draw what the camera sees, cars further than lodBoxDistance from the camera as single boxes
+	// and no poles further than lodPoleDistance, the start view is inside both
+	bool cull_render = true;
+	double lodBoxDistance = 90;
+	double lodPoleDistance = 100;
+	// Shapes the cars and poles may add to the viewer per frame, nearest cars first, poles last
+	int renderShapeBudget = 64;
+	// Outline the position uncertainty of the tracked cars
+	bool visualize_uncertainty = true;
+	// Track cars going straight with a linear constant velocity filter, and with the UKF while they turn
+	bool hybrid_tracking = false;
 	// Predict path in the future using UKF
 	double projectedTime = 0;
 	int projectedSteps = 0;
@@ -51,10 +132,7 @@ public:
 	
 		car1.setInstructions(car1_instructions);
 		if( trackCars[0] )
-		{
-			UKF ukf1;
-			car1.setUKF(ukf1);
-		}
+			car1.track = addTrack();
 		traffic.push_back(car1);
 		
 		Car car2(Vect3(25, -4, 0), Vect3(4, 2, 2), Color(0, 0, 1), -6, 0, 2, "car2");
@@ -65,10 +143,7 @@ public:
 		car2_instructions.push_back(a);
 		car2.setInstructions(car2_instructions);
 		if( trackCars[1] )
-		{
-			UKF ukf2;
-			car2.setUKF(ukf2);
-		}
+			car2.track = addTrack();
 		traffic.push_back(car2);
 	
 		Car car3(Vect3(-12, 0, 0), Vect3(4, 2, 2), Color(0, 0, 1), 1, 0, 2, "car3");
@@ -89,102 +164,266 @@ public:
 		car3_instructions.push_back(a);
 		car3.setInstructions(car3_instructions);
 		if( trackCars[2] )
-		{
-			UKF ukf3;
-			car3.setUKF(ukf3);
-		}
+			car3.track = addTrack();
 		traffic.push_back(car3);
 
-		lidar = new Lidar(traffic,0);
+		lidarSchedule.budget = radarSchedule.budget = trackBudget;
+		if(lock_tracker_memory && !trackPool.lock())
+			std::cerr << "track pool could not be locked" << std::endl;
+		if(tracker_threads > 0)
+		{
+			RealtimeConfig realtime;
+			realtime.cores = tracker_cores;
+			realtime.priority = tracker_priority;
+			trackerWorkers.start(tracker_threads, realtime);
+		}
+		kinematics.load(traffic);
+		trafficView.refresh(traffic);
+		for(const LidarMount& mount : lidarMounts)
+			lidarRig.addLidar(trafficView, 0, mount);
+		lidarRig.setRolling(rolling_scan, 1/scanRate);
+		// renderHighway spaces the poles from the back of the road
+		staticScene = StaticScene::highway(-15, roadLength);
+		lidarRig.observe(staticScene, egoVelocity);
 	
-		// render environment
-		renderHighway(0,viewer);
-		egoCar.render(viewer);
-		car1.render(viewer);
-		car2.render(viewer);
-		car3.render(viewer);
+		const char* rmseIds[4] = {"rmse_x", "rmse_y", "rmse_vx", "rmse_vy"};
+		const char* rmseFailIds[4] = {"rmse_fail_x", "rmse_fail_y", "rmse_fail_vx", "rmse_fail_vy"};
+		hud.print(viewer, hud.addLine("rmse", 30, 300, 20, Color(1, 1, 1)), "Accuracy - RMSE:");
+		for(int i = 0; i < 4; i++)
+			rmseLines[i] = hud.addLine(rmseIds[i], 30, 275-25*i, 20, Color(1, 1, 1));
+		rmseFailLine = hud.addLine("rmse_fail", 30, 150, 20, Color(1, 0, 0));
+		for(int i = 0; i < 4; i++)
+			rmseFailLines[i] = hud.addLine(rmseFailIds[i], 30, 125-25*i, 20, Color(1, 0, 0));
 	}
 	
-	void stepHighway(double egoVelocity, long long timestamp, int frame_per_sec, pcl::visualization::PCLVisualizer::Ptr& viewer)
+	// move the traffic to time_us, everything run at that time sees the cars there
+	void advanceTraffic(long long time_us)
 	{
+		if(time_us == trafficTime_us)
+			return;
+		trafficTime_us = time_us;
+		kinematics.advanceTo(time_us);
+		kinematics.store(traffic);
+		trafficView.refresh(traffic);
+	}
 
-		if(visualize_pcd)
+	// a track for a car, the tracked cars are set up with one each
+	size_t addTrack()
+	{
+		UKF::Config config;
+		config.SetHybrid(hybrid_tracking);
+		return trackPool.add(config);
+	}
+
+	// sense the tracked cars with lidar and update their UKFs
+	void senseLidar(long long timestamp)
+	{
+		std::vector<bool> tracked(trackPool.size());
+		for (const Car& car : traffic)
 		{
-			pcl::PointCloud<pcl::PointXYZ>::Ptr trafficCloud = tools.loadPcd("../src/sensors/data/pcd/highway_"+std::to_string(timestamp)+".pcd");
-			renderPointCloud(viewer, trafficCloud, "trafficCloud", Color((float)184/256,(float)223/256,(float)252/256));
+			if(car.track >= 0)
+				tracked[car.track] = true;
 		}
-		
+		const std::vector<uint8_t>& run = plan(lidarSchedule, tracked, "lidar", timestamp);
+		measurements.resize(trackPool.size());
+		for (const Car& car : traffic)
+		{
+			if(car.track >= 0 && run[car.track])
+				measurements[car.track] = tools.lidarMeasure(car, timestamp, visualize_lidar);
+		}
+		updateTracks(lidarSchedule, run);
+	}
 
-		// render highway environment with poles
-		renderHighway(egoVelocity*timestamp/1e6, viewer);
-		egoCar.render(viewer);
-		
-		for (int i = 0; i < traffic.size(); i++)
+	// sense the tracked cars with radar and update their UKFs, hidden cars get no update and coast
+	void senseRadar(long long timestamp)
+	{
+		std::vector<uint8_t> visible(traffic.size(), 1);
+		if(radar_occlusion)
 		{
-			traffic[i].move((double)1/frame_per_sec, timestamp);
-			if(!visualize_pcd)
-				traffic[i].render(viewer);
-			// Sense surrounding cars with lidar and radar
-			if(trackCars[i])
+			Vect3 radar(egoCar.position.x, egoCar.position.y, egoCar.position.z + radarHeight);
+			radarVisibility.run(trafficView, &staticScene, egoVelocity*timestamp/1e6, radar, visible);
+		}
+		std::vector<bool> tracked(trackPool.size());
+		for (size_t i = 0; i < traffic.size(); i++)
+		{
+			if(i < radarVisible.size() && visible[i] != radarVisible[i])
+				std::cout << traffic[i].name << (visible[i] ? " reacquired" : " hidden from") << " radar at " << timestamp << " us" << std::endl;
+			if(traffic[i].track >= 0)
+				tracked[traffic[i].track] = visible[i];
+		}
+		radarVisible = visible;
+		const std::vector<uint8_t>& run = plan(radarSchedule, tracked, "radar", timestamp);
+		measurements.resize(trackPool.size());
+		for (const Car& car : traffic)
+		{
+			if(car.track >= 0 && run[car.track])
+				measurements[car.track] = tools.radarMeasure(car, egoCar, timestamp, visualize_radar);
+		}
+		updateTracks(radarSchedule, run);
+	}
+
+	// the planned UKF updates of a tick, each track is updated in the pool by one worker and timed by it
+	void updateTracks(TrackScheduler& schedule, const std::vector<uint8_t>& run)
+	{
+		trackerWorkers.run(trackPool.size(), [&](size_t t)
+		{
+			if(run[t])
+				schedule.measure(t, [&]() { trackPool.update(t, measurements[t]); });
+		});
+	}
+
+	// the tracks a sensor tick updates, all tracked ones unless scheduling is on, overload is logged when it starts
+	const std::vector<uint8_t>& plan(TrackScheduler& schedule, const std::vector<bool>& tracked, const char* sensor, long long timestamp)
+	{
+		if(!schedule_tracks)
+		{
+			// sized here since the workers time their updates concurrently
+			schedule.cost.resize(tracked.size(), 0);
+			schedule.deferrals.resize(tracked.size(), 0);
+			schedule.run.assign(tracked.begin(), tracked.end());
+			return schedule.run;
+		}
+		int wasDeferred = schedule.deferred;
+		schedule.plan(trackPool, tracked);
+		if(schedule.deferred > 0 && wasDeferred == 0)
+			std::cout << sensor << " updates over budget at " << timestamp << " us, deferred " << schedule.deferred << " tracks" << std::endl;
+		return schedule.run;
+	}
+
+	// simulate the lidar point cloud, the latest cloud is rendered every frame
+	void scanLidar(long long timestamp)
+	{
+		if(scan_lidar)
+		{
+			double offset = egoVelocity*timestamp/1e6;
+			lidarRig.setStaticOffset(offset);
+			lidarRig.scan();
+			if(rolling_scan)
+			{
+				// the tracks estimate the cars where the sweep started, the traffic is still there
+				double smeared = lidarRig.onCarFraction(trafficView, 0.1);
+				lidarRig.deskew(traffic, trackPool, 0);
+				double deskewed = lidarRig.onCarFraction(trafficView, 0.1);
+				if(lidarRig.verbose && deskewed >= 0)
+					std::cout << "car points on their car at " << timestamp << " us: " << (int)(100*smeared) << "% as scanned, " << (int)(100*deskewed) << "% deskewed" << std::endl;
+			}
+			if(map_occupancy)
 			{
+				// every lidar's rays start from its own mount
+				occupancy.follow(offset);
+				for(const std::unique_ptr<Lidar>& lidar : lidarRig.lidars)
+					occupancy.update(*lidar->cloud, lidar->position, offset);
+			}
+		}
+	}
+
+	// log the UKF estimates of the tracked cars against ground truth
+	void evaluate(long long timestamp)
+	{
+		for (size_t i = 0; i < traffic.size(); i++)
+		{
+			if(traffic[i].track >= 0)
+			{
+				const UKF::StateVector& x = trackPool[traffic[i].track].x_;
 				VectorXd gt(4);
 				gt << traffic[i].position.x, traffic[i].position.y, traffic[i].velocity*cos(traffic[i].angle), traffic[i].velocity*sin(traffic[i].angle);
 				tools.ground_truth.push_back(gt);
-				tools.lidarSense(traffic[i], viewer, timestamp, visualize_lidar);
-				tools.radarSense(traffic[i], egoCar, viewer, timestamp, visualize_radar);
-				tools.ukfResults(traffic[i],viewer, projectedTime, projectedSteps);
 				VectorXd estimate(4);
-				double v  = traffic[i].ukf.x_(2);
-    			double yaw = traffic[i].ukf.x_(3);
+				double v  = x(2);
+    			double yaw = x(3);
     			double v1 = cos(yaw)*v;
     			double v2 = sin(yaw)*v;
-				estimate << traffic[i].ukf.x_[0], traffic[i].ukf.x_[1], v1, v2;
+				estimate << x[0], x[1], v1, v2;
 				tools.estimations.push_back(estimate);
-	
 			}
 		}
-		viewer->addText("Accuracy - RMSE:", 30, 300, 20, 1, 1, 1, "rmse");
-		VectorXd rmse = tools.CalculateRMSE(tools.estimations, tools.ground_truth);
-		viewer->addText(" X: "+std::to_string(rmse[0]), 30, 275, 20, 1, 1, 1, "rmse_x");
-		viewer->addText(" Y: "+std::to_string(rmse[1]), 30, 250, 20, 1, 1, 1, "rmse_y");
-		viewer->addText("Vx: "	+std::to_string(rmse[2]), 30, 225, 20, 1, 1, 1, "rmse_vx");
-		viewer->addText("Vy: "	+std::to_string(rmse[3]), 30, 200, 20, 1, 1, 1, "rmse_vy");
 
-		if(timestamp > 1.0e6)
+		if(check_collisions)
 		{
+			collisionWorld.update(trafficView);
+			for(const std::pair<size_t, size_t>& hit : collisionWorld.collisions(trafficView))
+				std::cout << traffic[hit.first].name << " collided with " << traffic[hit.second].name << " at " << timestamp << " us" << std::endl;
+		}
 
-			if(rmse[0] > rmseThreshold[0])
-			{
-				rmseFailLog[0] = rmse[0];
-				pass = false;
-			}
-			if(rmse[1] > rmseThreshold[1])
-			{
-				rmseFailLog[1] = rmse[1];
-				pass = false;
-			}
-			if(rmse[2] > rmseThreshold[2])
-			{
-				rmseFailLog[2] = rmse[2];
-				pass = false;
-			}
-			if(rmse[3] > rmseThreshold[3])
+		if(timestamp > 1.0e6)
+		{
+			VectorXd rmse = tools.CalculateRMSE(tools.estimations, tools.ground_truth);
+			for (int i = 0; i < 4; i++)
 			{
-				rmseFailLog[3] = rmse[3];
-				pass = false;
+				if(rmse[i] > rmseThreshold[i])
+				{
+					rmseFailLog[i] = rmse[i];
+					pass = false;
+				}
 			}
 		}
+	}
+
+	// draw the highway, the cars, the UKF results and the accuracy
+	void render(long long timestamp, pcl::visualization::PCLVisualizer::Ptr& viewer)
+	{
+
+		if(visualize_pcd)
+		{
+			pcl::PointCloud<pcl::PointXYZ>::Ptr trafficCloud = tools.loadPcd("../src/sensors/data/pcd/highway_"+std::to_string(timestamp)+".pcd");
+			renderPointCloud(viewer, trafficCloud, "trafficCloud", Color((float)184/256,(float)223/256,(float)252/256));
+		}
+		
+
+		// colored by return intensity
+		if(scan_lidar)
+			renderPointCloud(viewer, lidarRig.cloud, "lidarCloud");
+
+		RenderView view;
+		if(cull_render)
+		{
+			std::vector<pcl::visualization::Camera> cameras;
+			viewer->getCameras(cameras);
+			if(!cameras.empty())
+				view.setCamera(cameras[0]);
+			view.boxOnlyDistance = lodBoxDistance;
+			view.poleDistance = lodPoleDistance;
+			view.maxShapes = renderShapeBudget;
+		}
+
+		// the cars take the shape budget nearest to the camera first, the poles get what is left
+		egoCar.render(viewer, &view);
+		std::vector<size_t> order(traffic.size());
+		for (size_t i = 0; i < traffic.size(); i++)
+			order[i] = i;
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+		{
+			return view.distance(traffic[a].position.x, traffic[a].position.y, 0) < view.distance(traffic[b].position.x, traffic[b].position.y, 0);
+		});
+		for (size_t i : order)
+		{
+			if(!visualize_pcd)
+				traffic[i].render(viewer, &view);
+			if(traffic[i].track >= 0)
+				tools.ukfResults(trackPool, traffic[i].track, viewer, projectedTime, projectedSteps);
+		}
+
+		// render highway environment with poles
+		renderHighway(egoVelocity*timestamp/1e6, viewer, &view);
+		// all tracks' ellipses are solved together and drawn as one line set
+		if(visualize_uncertainty)
+			tools.ellipses.draw(tools.markers.uncertainty, 3.5, Color(0, 1, 0));
+		tools.ellipses.clear();
+		tools.markers.flush(viewer);
+		// the hud only touches the viewer for lines whose text changed
+		const char* labels[4] = {" X", " Y", "Vx", "Vy"};
+		VectorXd rmse = tools.CalculateRMSE(tools.estimations, tools.ground_truth);
+		for(int i = 0; i < 4; i++)
+			hud.print(viewer, rmseLines[i], "%s: %f", labels[i], rmse[i]);
+
 		if(!pass)
 		{
-			viewer->addText("RMSE Failed Threshold", 30, 150, 20, 1, 0, 0, "rmse_fail");
-			if(rmseFailLog[0] > 0)
-				viewer->addText(" X: "+std::to_string(rmseFailLog[0]), 30, 125, 20, 1, 0, 0, "rmse_fail_x");
-			if(rmseFailLog[1] > 0)
-				viewer->addText(" Y: "+std::to_string(rmseFailLog[1]), 30, 100, 20, 1, 0, 0, "rmse_fail_y");
-			if(rmseFailLog[2] > 0)
-				viewer->addText("Vx: "+std::to_string(rmseFailLog[2]), 30, 75, 20, 1, 0, 0, "rmse_fail_vx");
-			if(rmseFailLog[3] > 0)
-				viewer->addText("Vy: "+std::to_string(rmseFailLog[3]), 30, 50, 20, 1, 0, 0, "rmse_fail_vy");
+			hud.print(viewer, rmseFailLine, "RMSE Failed Threshold");
+			for(int i = 0; i < 4; i++)
+			{
+				if(rmseFailLog[i] > 0)
+					hud.print(viewer, rmseFailLines[i], "%s: %f", labels[i], rmseFailLog[i]);
+			}
 		}
 		
 	}
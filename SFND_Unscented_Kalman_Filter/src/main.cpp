@@ -4,6 +4,7 @@
 
 //#include "render/render.h"
 #include "highway.h"
+#include "simulator.h"
 
 int main(int argc, char** argv)
 {
@@ -22,23 +23,41 @@ int main(int argc, char** argv)
 
 	int frame_per_sec = 30;
 	int sec_interval = 10;
-	int frame_count = 0;
-	int time_us = 0;
 
-	double egoVelocity = 25;
-
-	while (frame_count < (frame_per_sec*sec_interval))
+	// every event first moves the traffic to its own time, events at the same time move it once
+	Simulator sim;
+	sim.schedulePeriodic(0, highway.lidarRate, [&](long long time_us)
+	{
+		highway.advanceTraffic(time_us);
+		highway.senseLidar(time_us);
+	});
+	sim.schedulePeriodic(0, highway.radarRate, [&](long long time_us)
+	{
+		highway.advanceTraffic(time_us);
+		highway.senseRadar(time_us);
+	});
+	if(highway.scan_lidar)
+	{
+		sim.schedulePeriodic(0, highway.scanRate, [&](long long time_us)
+		{
+			highway.advanceTraffic(time_us);
+			highway.scanLidar(time_us);
+		});
+	}
+	// render ticks also log accuracy, shapes and sensor markers added since the last tick are shown and
+	// then cleared, the hud stays
+	sim.schedulePeriodic(0, frame_per_sec, [&](long long time_us)
 	{
+		highway.advanceTraffic(time_us);
+		highway.evaluate(time_us);
+		highway.render(time_us, viewer);
+		viewer->spinOnce(1000/frame_per_sec);
 		viewer->removeAllPointClouds();
-		viewer->removeAllShapes();
+		ActorTable::scene().removeShown(viewer);
+		highway.tools.markers.clear();
+	});
+	sim.runUntil((long long)sec_interval*1000000);
 
-		//stepHighway(egoVelocity,time_us, frame_per_sec, viewer);
-		highway.stepHighway(egoVelocity,time_us, frame_per_sec, viewer);
-		viewer->spinOnce(1000/frame_per_sec);
-		frame_count++;
-		time_us = 1000000*frame_count/frame_per_sec;
-		
-	}
 	highway.tools.saveRMSE("RMSE.txt"); // output final RMSE values to a file
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,91 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+// where and how urgently tracker threads run. Workers are pinned round robin to cores and
+// run with SCHED_FIFO at priority when it is above 0. Empty cores and priority 0 leave the
+// OS in charge.
+struct RealtimeConfig
+{
+	std::vector<int> cores;
+	int priority;
+
+	RealtimeConfig()
+		: priority(0)
+	{}
+};
+
+// thread placement, scheduling and memory locking. Everything but Linux has none of it and
+// every call returns false. Real time priorities and locking usually need CAP_SYS_NICE and
+// CAP_IPC_LOCK or raised rlimits, without them the calls fail and the thread runs as before.
+struct Realtime
+{
+
+	// pin the calling thread to one core
+	static bool pin(int core)
+	{
+#ifdef __linux__
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(core, &cpus);
+		return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+		return false;
+#endif
+	}
+
+	// run the calling thread first in first out at a priority clamped to the allowed range
+	static bool fifo(int priority)
+	{
+#ifdef __linux__
+		sched_param param;
+		param.sched_priority = std::max(sched_get_priority_min(SCHED_FIFO), std::min(sched_get_priority_max(SCHED_FIFO), priority));
+		return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#else
+		return false;
+#endif
+	}
+
+	// keep a memory range, such as a track pool, in RAM so touching it never page faults
+	static bool lock(const void* address, size_t bytes)
+	{
+#ifdef __linux__
+		return mlock(address, bytes) == 0;
+#else
+		return false;
+#endif
+	}
+
+	static bool unlock(const void* address, size_t bytes)
+	{
+#ifdef __linux__
+		return munlock(address, bytes) == 0;
+#else
+		return false;
+#endif
+	}
+
+	// set up the calling thread as worker number worker, failures are reported and ignored
+	static void apply(const RealtimeConfig& config, int worker, const char* name)
+	{
+		if(!config.cores.empty())
+		{
+			int core = config.cores[worker % config.cores.size()];
+			if(!pin(core))
+				std::cerr << name << " " << worker << " could not be pinned to core " << core << std::endl;
+		}
+		if(config.priority > 0 && !fifo(config.priority))
+			std::cerr << name << " " << worker << " could not run SCHED_FIFO at priority " << config.priority << std::endl;
+	}
+
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef ACTOR_TABLE_H
+#define ACTOR_TABLE_H
+#include <pcl/visualization/pcl_visualizer.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef int ActorHandle;
+
+// string ids of the viewer's shapes interned once into integer handles. Renderers keep
+// handles and pass the stored id strings to the viewer, so drawing a frame builds no strings.
+// The handles of shapes drawn since the last clear are kept so the frame can be taken down
+// again without asking the viewer for its shapes.
+struct ActorTable
+{
+
+	std::vector<std::string> ids;
+	std::unordered_map<std::string, ActorHandle> handles;
+	std::vector<ActorHandle> shown;
+
+	// handle of an id, made the first time the id is seen
+	ActorHandle intern(const std::string& id)
+	{
+		std::unordered_map<std::string, ActorHandle>::iterator it = handles.find(id);
+		if(it != handles.end())
+			return it->second;
+		ids.push_back(id);
+		handles[id] = ids.size()-1;
+		return ids.size()-1;
+	}
+
+	const std::string& operator[](ActorHandle handle) const
+	{
+		return ids[handle];
+	}
+
+	// id for a shape being added to the viewer this frame
+	const std::string& show(ActorHandle handle)
+	{
+		shown.push_back(handle);
+		return ids[handle];
+	}
+
+	// remove every shape shown since the last call
+	void removeShown(pcl::visualization::PCLVisualizer::Ptr& viewer)
+	{
+		for(ActorHandle handle : shown)
+			viewer->removeShape(ids[handle]);
+		shown.clear();
+	}
+
+	// the table all scene renderers share
+	static ActorTable& scene()
+	{
+		static ActorTable table;
+		return table;
+	}
+
+};
+
+// handles of the shapes drawn for one car, interned once when the car is named.
+// Its sensor and estimate markers are drawn in batches, see MarkerBatches.
+struct CarActors
+{
+	ActorHandle body, bodyFrame, top, topFrame;
+
+	CarActors()
+		: body(-1), bodyFrame(-1), top(-1), topFrame(-1)
+	{}
+
+	CarActors(const std::string& name)
+	{
+		ActorTable& table = ActorTable::scene();
+		body = table.intern(name);
+		bodyFrame = table.intern(name+"frame");
+		top = table.intern(name+"Top");
+		topFrame = table.intern(name+"Topframe");
+	}
+};
+
+#endif
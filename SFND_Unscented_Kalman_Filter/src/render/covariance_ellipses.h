@@ -0,0 +1,128 @@
+#ifndef COVARIANCE_ELLIPSES_H
+#define COVARIANCE_ELLIPSES_H
+#include "marker_batch.h"
+#include "../ukf.h"
+#include <algorithm>
+#include <cmath>
+
+// position uncertainty of every track drawn as ellipses in one line batch. Tracks add the
+// 2x2 position block of their covariance, solve finds the axes of all of them at once with
+// the closed form eigen decomposition of a symmetric 2x2, and draw outlines them.
+// The inputs and results are kept as one array per value so the solve loops have no branches.
+// The solve takes only sqrt, no atan2, so with -O3 and -fno-math-errno, which the project build
+// sets, the compiler runs both loops across several tracks per instruction.
+struct CovarianceEllipses
+{
+
+	// how many standard deviations the outline is from the center, 2.45 holds 95% of a 2D gaussian
+	float sigma;
+	int segments;
+	// center and covariance pxx pxy pyy of every track
+	std::vector<float> x, y, pxx, pxy, pyy;
+	// half axis lengths and the direction of the major axis
+	std::vector<float> major, minor, cosAngle, sinAngle;
+	// unit circle the outlines are scaled from
+	std::vector<float> circleX, circleY;
+
+	CovarianceEllipses(float setSigma = 2.45, int setSegments = 24)
+		: sigma(setSigma), segments(setSegments)
+	{
+		for(int i = 0; i <= segments; i++)
+		{
+			circleX.push_back(cos(2*M_PI*i/segments));
+			circleY.push_back(sin(2*M_PI*i/segments));
+		}
+	}
+
+	size_t size() const
+	{
+		return x.size();
+	}
+
+	void add(float setX, float setY, float setPxx, float setPxy, float setPyy)
+	{
+		x.push_back(setX);
+		y.push_back(setY);
+		pxx.push_back(setPxx);
+		pxy.push_back(setPxy);
+		pyy.push_back(setPyy);
+	}
+
+	// the position estimate and its covariance of an initialized track
+	void add(const UKF::State& state)
+	{
+		if(!state.IsInitialized())
+			return;
+		const UKF::StateMatrix& P = state.P_;
+		add(state.x_[0], state.x_[1], P(0, 0), P(0, 1), P(1, 1));
+	}
+
+	void clear()
+	{
+		x.clear();
+		y.clear();
+		pxx.clear();
+		pxy.clear();
+		pyy.clear();
+	}
+
+	// eigenvalues are the mean of the diagonal plus or minus the radius r, the major axis is at
+	// half the angle whose cos and sin are (pxx-pyy)/2r and pxy/r
+	void solve()
+	{
+		size_t n = size();
+		major.resize(n);
+		minor.resize(n);
+		cosAngle.resize(n);
+		sinAngle.resize(n);
+		const float* a = pxx.data();
+		const float* b = pxy.data();
+		const float* c = pyy.data();
+		float* axis1 = major.data();
+		float* axis2 = minor.data();
+		float* cosA = cosAngle.data();
+		float* sinA = sinAngle.data();
+		// two loops so each touches few enough arrays for the compiler's aliasing checks, sqrt only
+		// vectorizes when it doesn't have to set errno
+		for(size_t i = 0; i < n; i++)
+		{
+			float mean = (a[i]+c[i])/2;
+			float half = (a[i]-c[i])/2;
+			float r = std::sqrt(half*half + b[i]*b[i]);
+			axis1[i] = sigma*std::sqrt(mean+r);
+			axis2[i] = sigma*std::sqrt(std::max(mean-r, 0.0f));
+		}
+		for(size_t i = 0; i < n; i++)
+		{
+			float half = (a[i]-c[i])/2;
+			// a round ellipse has no direction, the small floor keeps it from dividing by zero
+			float cos2 = half/(std::sqrt(half*half + b[i]*b[i]) + 1e-12f);
+			cosA[i] = std::sqrt(std::max((1+cos2)/2, 0.0f));
+			sinA[i] = std::copysign(std::sqrt(std::max((1-cos2)/2, 0.0f)), b[i]);
+		}
+	}
+
+	// solve and outline every ellipse at height z
+	void draw(MarkerBatch& lines, float z, Color color)
+	{
+		solve();
+		for(size_t i = 0; i < size(); i++)
+		{
+			float ux = major[i]*cosAngle[i], uy = major[i]*sinAngle[i];
+			float vx = -minor[i]*sinAngle[i], vy = minor[i]*cosAngle[i];
+			float fromX = x[i] + ux*circleX[0] + vx*circleY[0];
+			float fromY = y[i] + uy*circleX[0] + vy*circleY[0];
+			for(int s = 1; s <= segments; s++)
+			{
+				float toX = x[i] + ux*circleX[s] + vx*circleY[s];
+				float toY = y[i] + uy*circleX[s] + vy*circleY[s];
+				lines.addLine(fromX, fromY, z, toX, toY, z, color);
+				fromX = toX;
+				fromY = toY;
+			}
+		}
+	}
+
+};
+
+#endif
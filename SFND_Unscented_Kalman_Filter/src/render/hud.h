@@ -0,0 +1,73 @@
+#ifndef HUD_H
+#define HUD_H
+#include "render.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+// text overlay that stays in the viewer between frames. Every line's text actor is created
+// the first time it shows something and after that only updated when its text changes.
+// Lines are formatted into fixed buffers so an unchanged line costs one string compare.
+struct Hud
+{
+
+	struct Line
+	{
+		std::string id;
+		int x, y, fontSize;
+		Color color;
+		char text[64];
+		bool created;
+
+		Line(const std::string& setId, int setX, int setY, int setFontSize, Color setColor)
+			: id(setId), x(setX), y(setY), fontSize(setFontSize), color(setColor), created(false)
+		{
+			text[0] = '\0';
+		}
+	};
+
+	std::vector<Line> lines;
+
+	// add a line, returns the index used to print to it
+	int addLine(const std::string& id, int x, int y, int fontSize, Color color)
+	{
+		lines.push_back(Line(id, x, y, fontSize, color));
+		return lines.size()-1;
+	}
+
+	// printf into a line, the viewer is only touched if the text changed
+	void print(pcl::visualization::PCLVisualizer::Ptr& viewer, int line, const char* format, ...)
+	{
+		char text[sizeof(lines[line].text)];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(text, sizeof(text), format, args);
+		va_end(args);
+		show(viewer, line, text);
+	}
+
+	// an empty line keeps its actor with no text so it can come back without being created again
+	void clear(pcl::visualization::PCLVisualizer::Ptr& viewer, int line)
+	{
+		show(viewer, line, "");
+	}
+
+	void show(pcl::visualization::PCLVisualizer::Ptr& viewer, int index, const char* text)
+	{
+		Line& line = lines[index];
+		if(line.created && strcmp(line.text, text) == 0)
+			return;
+		if(!line.created && text[0] == '\0')
+			return;
+		strncpy(line.text, text, sizeof(line.text)-1);
+		line.text[sizeof(line.text)-1] = '\0';
+		if(line.created)
+			viewer->updateText(line.text, line.x, line.y, line.fontSize, line.color.r, line.color.g, line.color.b, line.id);
+		else
+			viewer->addText(line.text, line.x, line.y, line.fontSize, line.color.r, line.color.g, line.color.b, line.id);
+		line.created = true;
+	}
+
+};
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef MARKER_BATCH_H
+#define MARKER_BATCH_H
+#include "render.h"
+#include <vtkSmartPointer.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkPointData.h>
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkUnsignedCharArray.h>
+#include <vtkGlyph3D.h>
+#include <vtkSphereSource.h>
+#include <vtkArrowSource.h>
+#include <cstring>
+
+// many markers of one kind drawn as a single viewer shape. Markers are collected into flat
+// arrays, flush copies the arrays into the shape's polydata and the shape is added to the
+// viewer only once, so the actor count doesn't grow with the number of markers.
+struct MarkerBatch
+{
+
+	enum Kind { SPHERES, ARROWS, LINES };
+
+	Kind kind;
+	std::string id;
+	// x y z of every marker, the start of arrows and lines
+	std::vector<float> positions;
+	// arrow vectors and line ends
+	std::vector<float> vectors;
+	// r g b a of every marker, 0-255
+	std::vector<unsigned char> colors;
+	bool added;
+
+	vtkSmartPointer<vtkPoints> points;
+	vtkSmartPointer<vtkUnsignedCharArray> pointColors;
+	vtkSmartPointer<vtkFloatArray> pointVectors;
+	vtkSmartPointer<vtkCellArray> lines;
+	vtkSmartPointer<vtkPolyData> input;
+	vtkSmartPointer<vtkGlyph3D> glyphs;
+
+	MarkerBatch(Kind setKind, const std::string& setId, double sphereRadius = 0.5)
+		: kind(setKind), id(setId), added(false)
+	{
+		points = vtkSmartPointer<vtkPoints>::New();
+		points->SetDataTypeToFloat();
+		pointColors = vtkSmartPointer<vtkUnsignedCharArray>::New();
+		pointColors->SetNumberOfComponents(4);
+		pointColors->SetName("colors");
+		pointVectors = vtkSmartPointer<vtkFloatArray>::New();
+		pointVectors->SetNumberOfComponents(3);
+		input = vtkSmartPointer<vtkPolyData>::New();
+		input->SetPoints(points);
+		input->GetPointData()->SetScalars(pointColors);
+		if(kind == LINES)
+		{
+			lines = vtkSmartPointer<vtkCellArray>::New();
+			input->SetLines(lines);
+			return;
+		}
+
+		glyphs = vtkSmartPointer<vtkGlyph3D>::New();
+		if(kind == SPHERES)
+		{
+			vtkSmartPointer<vtkSphereSource> sphere = vtkSmartPointer<vtkSphereSource>::New();
+			sphere->SetRadius(sphereRadius);
+			glyphs->SetSourceConnection(sphere->GetOutputPort());
+			glyphs->SetScaleModeToDataScalingOff();
+			glyphs->OrientOff();
+		}
+		else
+		{
+			// unit arrow along x, turned along and stretched to each marker's vector
+			vtkSmartPointer<vtkArrowSource> arrow = vtkSmartPointer<vtkArrowSource>::New();
+			glyphs->SetSourceConnection(arrow->GetOutputPort());
+			input->GetPointData()->SetVectors(pointVectors);
+			glyphs->SetVectorModeToUseVector();
+			glyphs->SetScaleModeToScaleByVector();
+			glyphs->OrientOn();
+		}
+		glyphs->SetColorModeToColorByScalar();
+		glyphs->SetInputData(input);
+	}
+
+	size_t size() const
+	{
+		return positions.size()/3;
+	}
+
+	void clear()
+	{
+		positions.clear();
+		vectors.clear();
+		colors.clear();
+	}
+
+	void addSphere(double x, double y, double z, Color color, double opacity = 1)
+	{
+		push(positions, x, y, z);
+		pushColor(color, opacity);
+	}
+
+	// arrow and line markers from (x, y, z) to (x, y, z) + (dx, dy, dz)
+	void addArrow(double x, double y, double z, double dx, double dy, double dz, Color color)
+	{
+		push(positions, x, y, z);
+		push(vectors, dx, dy, dz);
+		pushColor(color, 1);
+	}
+
+	void addLine(double x, double y, double z, double toX, double toY, double toZ, Color color)
+	{
+		addArrow(x, y, z, toX-x, toY-y, toZ-z, color);
+	}
+
+	static void push(std::vector<float>& values, double x, double y, double z)
+	{
+		values.push_back(x);
+		values.push_back(y);
+		values.push_back(z);
+	}
+
+	void pushColor(Color color, double opacity)
+	{
+		colors.push_back(color.r*255);
+		colors.push_back(color.g*255);
+		colors.push_back(color.b*255);
+		colors.push_back(opacity*255);
+	}
+
+	// copy the markers into the polydata and show them, the shape is created on the first flush
+	void flush(pcl::visualization::PCLVisualizer::Ptr& viewer)
+	{
+		size_t n = size();
+		// a line is two points, its start and its end, with the marker's color on both
+		size_t vertices = (kind == LINES) ? 2*n : n;
+		points->SetNumberOfPoints(vertices);
+		pointColors->SetNumberOfTuples(vertices);
+		float* xyz = static_cast<float*>(points->GetVoidPointer(0));
+		unsigned char* rgba = pointColors->GetPointer(0);
+		if(kind == LINES)
+		{
+			lines->Reset();
+			for(size_t i = 0; i < n; i++)
+			{
+				for(int axis = 0; axis < 3; axis++)
+				{
+					xyz[6*i+axis] = positions[3*i+axis];
+					xyz[6*i+3+axis] = positions[3*i+axis] + vectors[3*i+axis];
+				}
+				memcpy(rgba+8*i, &colors[4*i], 4);
+				memcpy(rgba+8*i+4, &colors[4*i], 4);
+				lines->InsertNextCell(2);
+				lines->InsertCellPoint(2*i);
+				lines->InsertCellPoint(2*i+1);
+			}
+			lines->Modified();
+		}
+		else
+		{
+			if(n > 0)
+			{
+				memcpy(xyz, positions.data(), positions.size()*sizeof(float));
+				memcpy(rgba, colors.data(), colors.size());
+			}
+			if(kind == ARROWS)
+			{
+				pointVectors->SetNumberOfTuples(n);
+				if(n > 0)
+					memcpy(pointVectors->GetPointer(0), vectors.data(), vectors.size()*sizeof(float));
+				pointVectors->Modified();
+			}
+		}
+		points->Modified();
+		pointColors->Modified();
+		input->Modified();
+
+		if(glyphs)
+			glyphs->Update();
+		if(!added)
+			added = viewer->addModelFromPolyData(glyphs ? glyphs->GetOutput() : input.Get(), id);
+	}
+
+};
+
+// every sensor and estimate marker of the highway, each kind in one batch
+struct MarkerBatches
+{
+
+	MarkerBatch lidarMarkers, radarRays, radarRates, estimates, velocities, uncertainty;
+
+	MarkerBatches()
+		: lidarMarkers(MarkerBatch::SPHERES, "lidarMarkers"), radarRays(MarkerBatch::LINES, "radarRays"), radarRates(MarkerBatch::ARROWS, "radarRates"),
+		  estimates(MarkerBatch::SPHERES, "ukfEstimates"), velocities(MarkerBatch::ARROWS, "ukfVelocities"),
+		  uncertainty(MarkerBatch::LINES, "ukfUncertainty")
+	{}
+
+	void flush(pcl::visualization::PCLVisualizer::Ptr& viewer)
+	{
+		lidarMarkers.flush(viewer);
+		radarRays.flush(viewer);
+		radarRates.flush(viewer);
+		estimates.flush(viewer);
+		velocities.flush(viewer);
+		uncertainty.flush(viewer);
+	}
+
+	void clear()
+	{
+		lidarMarkers.clear();
+		radarRays.clear();
+		radarRates.clear();
+		estimates.clear();
+		velocities.clear();
+		uncertainty.clear();
+	}
+
+};
+
+#endif
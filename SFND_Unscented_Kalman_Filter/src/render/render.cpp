@@ -4,7 +4,7 @@
 
 #include "render.h"
 
-void renderHighway(double distancePos, pcl::visualization::PCLVisualizer::Ptr& viewer)
+void renderHighway(double distancePos, pcl::visualization::PCLVisualizer::Ptr& viewer, RenderView* view)
 {
 
 	// units in meters
@@ -13,13 +13,30 @@ void renderHighway(double distancePos, pcl::visualization::PCLVisualizer::Ptr& v
 	double roadWidth = 12.0;
 	double roadHeight = 0.2; 
 
-	viewer->addCube(roadLengthBehind, roadLengthAhead, -roadWidth / 2, roadWidth / 2, -roadHeight, 0, .2, .2, .2, "highwayPavement");
-	viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_SURFACE, "highwayPavement");
-	viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_OPACITY, 1.0, "highwayPavement");
-	viewer->addLine(pcl::PointXYZ(roadLengthBehind, -roadWidth / 6, 0.01), pcl::PointXYZ(roadLengthAhead , -roadWidth / 6, 0.01), 1, 1, 0, "line1");
-	viewer->addLine(pcl::PointXYZ(roadLengthBehind, roadWidth / 6, 0.01), pcl::PointXYZ(roadLengthAhead, roadWidth / 6, 0.01), 1, 1, 0, "line2");
-
-	// render poles
+	// ids are interned on the first call
+	ActorTable& table = ActorTable::scene();
+	static const ActorHandle pavement = table.intern("highwayPavement");
+	static const ActorHandle line1 = table.intern("line1");
+	static const ActorHandle line2 = table.intern("line2");
+	static const ActorHandle railLeft = table.intern("railLeft");
+	static const ActorHandle railRight = table.intern("railRight");
+
+	viewer->addCube(roadLengthBehind, roadLengthAhead, -roadWidth / 2, roadWidth / 2, -roadHeight, 0, .2, .2, .2, table.show(pavement));
+	viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_SURFACE, table[pavement]);
+	viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_OPACITY, 1.0, table[pavement]);
+	viewer->addLine(pcl::PointXYZ(roadLengthBehind, -roadWidth / 6, 0.01), pcl::PointXYZ(roadLengthAhead , -roadWidth / 6, 0.01), 1, 1, 0, table.show(line1));
+	viewer->addLine(pcl::PointXYZ(roadLengthBehind, roadWidth / 6, 0.01), pcl::PointXYZ(roadLengthAhead, roadWidth / 6, 0.01), 1, 1, 0, table.show(line2));
+
+	// render guardrails along both road edges, same size as in StaticScene::highway
+	double railWidth = 0.2;
+	double railBottom = 0.4;
+	double railTop = 0.8;
+	viewer->addCube(roadLengthBehind, roadLengthAhead, roadWidth / 2, roadWidth / 2 + railWidth, railBottom, railTop, 0.7, 0.7, 0.7, table.show(railLeft));
+	viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_SURFACE, table[railLeft]);
+	viewer->addCube(roadLengthBehind, roadLengthAhead, -roadWidth / 2 - railWidth, -roadWidth / 2, railBottom, railTop, 0.7, 0.7, 0.7, table.show(railRight));
+	viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_SURFACE, table[railRight]);
+
+	// render poles, with a view only the ones on screen and near the camera while the budget lasts
 	// spacing in meters between poles, poles start at x = 0
 	double poleSpace = 10;
 	// pole distance from road curve
@@ -32,19 +49,35 @@ void renderHighway(double distancePos, pcl::visualization::PCLVisualizer::Ptr& v
 	while(markerPos < roadLengthBehind)
 		markerPos+=poleSpace;
 	int poleIndex = 0;
+	// four shapes per pole: left, left frame, right, right frame
+	static std::vector<ActorHandle> poleActors;
 	while(markerPos <= roadLengthAhead) 
 	{
-		//	left pole
-		viewer->addCube(-poleWidth/2+markerPos, poleWidth/2+markerPos, -poleWidth/2+roadWidth/2+poleCurve, poleWidth/2+roadWidth/2+poleCurve, 0, poleHeight, 1, 0.5, 0, "pole_"+std::to_string(poleIndex)+"l");
-		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_SURFACE, "pole_"+std::to_string(poleIndex)+"l");
-		viewer->addCube(-poleWidth/2+markerPos, poleWidth/2+markerPos, -poleWidth/2+roadWidth/2+poleCurve, poleWidth/2+roadWidth/2+poleCurve, 0, poleHeight, 0, 0, 0, "pole_"+std::to_string(poleIndex)+"lframe");
-		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_WIREFRAME, "pole_"+std::to_string(poleIndex)+"lframe");
-
-		//	right pole
-		viewer->addCube(-poleWidth/2+markerPos, poleWidth/2+markerPos, -poleWidth/2-roadWidth/2-poleCurve, poleWidth/2-roadWidth/2-poleCurve, 0, poleHeight, 1, 0.5, 0, "pole_"+std::to_string(poleIndex)+"r");
-		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_SURFACE, "pole_"+std::to_string(poleIndex)+"r");
-		viewer->addCube(-poleWidth/2+markerPos, poleWidth/2+markerPos, -poleWidth/2-roadWidth/2-poleCurve, poleWidth/2-roadWidth/2-poleCurve, 0, poleHeight, 0, 0, 0, "pole_"+std::to_string(poleIndex)+"rframe");
-		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_WIREFRAME, "pole_"+std::to_string(poleIndex)+"rframe");
+		if((int)poleActors.size() <= 4*poleIndex)
+		{
+			std::string pole = "pole_"+std::to_string(poleIndex);
+			poleActors.push_back(table.intern(pole+"l"));
+			poleActors.push_back(table.intern(pole+"lframe"));
+			poleActors.push_back(table.intern(pole+"r"));
+			poleActors.push_back(table.intern(pole+"rframe"));
+		}
+		const ActorHandle* actors = &poleActors[4*poleIndex];
+
+		Box poles[2];
+		poles[0] = {(float)(-poleWidth/2+markerPos), (float)(-poleWidth/2+roadWidth/2+poleCurve), 0, (float)(poleWidth/2+markerPos), (float)(poleWidth/2+roadWidth/2+poleCurve), (float)poleHeight};
+		poles[1] = {poles[0].x_min, -poles[0].y_max, 0, poles[0].x_max, -poles[0].y_min, poles[0].z_max};
+		bool near = !view || view->distance(markerPos, 0, poleHeight/2) <= view->poleDistance;
+		// left pole then right pole, each a surface and a frame
+		for(int side = 0; side < 2 && near; side++)
+		{
+			const Box& pole = poles[side];
+			if(view && !(view->visible(pole) && view->take(2)))
+				continue;
+			viewer->addCube(pole.x_min, pole.x_max, pole.y_min, pole.y_max, pole.z_min, pole.z_max, 1, 0.5, 0, table.show(actors[2*side]));
+			viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_SURFACE, table[actors[2*side]]);
+			viewer->addCube(pole.x_min, pole.x_max, pole.y_min, pole.y_max, pole.z_min, pole.z_max, 0, 0, 0, table.show(actors[2*side+1]));
+			viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_WIREFRAME, table[actors[2*side+1]]);
+		}
 
 		markerPos+=poleSpace;
 		poleIndex++;
@@ -6,10 +6,11 @@
 #define RENDER_H
 #include <pcl/visualization/pcl_visualizer.h>
 #include "box.h"
+#include "actor_table.h"
+#include "render_view.h"
 #include <iostream>
 #include <vector>
 #include <string>
-#include "../ukf.h"
 
 struct Color
 {
@@ -68,7 +69,10 @@ struct Car
 	// distance between front of vehicle and center of gravity
 	float Lf;
 
-	UKF ukf;
+	// index of the car's track in the tracker's pool, -1 if the car isn't tracked
+	int track;
+	// viewer handles of the car's shapes and markers
+	CarActors actors;
 
 	//accuation instructions
 	std::vector<accuation> instructions;
@@ -78,11 +82,11 @@ struct Car
 	double cosNegTheta;
 
 	Car()
-		: position(Vect3(0,0,0)), dimensions(Vect3(0,0,0)), color(Color(0,0,0))
+		: position(Vect3(0,0,0)), dimensions(Vect3(0,0,0)), color(Color(0,0,0)), track(-1)
 	{}
  
 	Car(Vect3 setPosition, Vect3 setDimensions, Color setColor, float setVelocity, float setAngle, float setLf, std::string setName)
-		: position(setPosition), dimensions(setDimensions), color(setColor), velocity(setVelocity), angle(setAngle), Lf(setLf), name(setName)
+		: position(setPosition), dimensions(setDimensions), color(setColor), velocity(setVelocity), angle(setAngle), Lf(setLf), name(setName), track(-1), actors(setName)
 	{
 		orientation = getQuaternion(angle);
 		acceleration = 0;
@@ -106,24 +110,45 @@ struct Car
 		return q;
 	}
 
-	void render(pcl::visualization::PCLVisualizer::Ptr& viewer)
+	// with a view the car is culled when off screen, drawn as one box when far from the camera
+	// and skipped when the frame's shape budget is spent
+	void render(pcl::visualization::PCLVisualizer::Ptr& viewer, RenderView* view = nullptr)
 	{
+		ActorTable& table = ActorTable::scene();
+		if(view)
+		{
+			// footprint of the car at any heading
+			float reach = sqrt(dimensions.x*dimensions.x + dimensions.y*dimensions.y)/2;
+			Box bounds = {(float)position.x-reach, (float)position.y-reach, 0, (float)position.x+reach, (float)position.y+reach, (float)dimensions.z};
+			if(!view->visible(bounds))
+				return;
+			bool boxOnly = view->distance(position.x, position.y, dimensions.z/2) > view->boxOnlyDistance;
+			if(!view->take(boxOnly ? 1 : 4))
+				return;
+			if(boxOnly)
+			{
+				viewer->addCube(Eigen::Vector3f(position.x, position.y, dimensions.z/2), orientation, dimensions.x, dimensions.y, dimensions.z, table.show(actors.body));
+				viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, color.r, color.g, color.b, table[actors.body]);
+				viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_SURFACE, table[actors.body]);
+				return;
+			}
+		}
 		// render bottom of car
-		viewer->addCube(Eigen::Vector3f(position.x, position.y, dimensions.z*1/3), orientation, dimensions.x, dimensions.y, dimensions.z*2/3, name);
-		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, color.r, color.g, color.b, name);
-		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_SURFACE, name);
-		viewer->addCube(Eigen::Vector3f(position.x, position.y, dimensions.z*1/3), orientation, dimensions.x, dimensions.y, dimensions.z*2/3, name+"frame");
-		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 0, 0, name+"frame");
-		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_WIREFRAME, name+"frame");
+		viewer->addCube(Eigen::Vector3f(position.x, position.y, dimensions.z*1/3), orientation, dimensions.x, dimensions.y, dimensions.z*2/3, table.show(actors.body));
+		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, color.r, color.g, color.b, table[actors.body]);
+		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_SURFACE, table[actors.body]);
+		viewer->addCube(Eigen::Vector3f(position.x, position.y, dimensions.z*1/3), orientation, dimensions.x, dimensions.y, dimensions.z*2/3, table.show(actors.bodyFrame));
+		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 0, 0, table[actors.bodyFrame]);
+		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_WIREFRAME, table[actors.bodyFrame]);
 		
 
 		// render top of car
-		viewer->addCube(Eigen::Vector3f(position.x, position.y, dimensions.z*5/6), orientation, dimensions.x/2, dimensions.y, dimensions.z*1/3, name + "Top");
-		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, color.r, color.g, color.b, name + "Top");
-		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_SURFACE, name + "Top");
-		viewer->addCube(Eigen::Vector3f(position.x, position.y, dimensions.z*5/6), orientation, dimensions.x/2, dimensions.y, dimensions.z*1/3, name + "Topframe");
-		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 0, 0, name+"Topframe");
-		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_WIREFRAME, name+"Topframe");
+		viewer->addCube(Eigen::Vector3f(position.x, position.y, dimensions.z*5/6), orientation, dimensions.x/2, dimensions.y, dimensions.z*1/3, table.show(actors.top));
+		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, color.r, color.g, color.b, table[actors.top]);
+		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_SURFACE, table[actors.top]);
+		viewer->addCube(Eigen::Vector3f(position.x, position.y, dimensions.z*5/6), orientation, dimensions.x/2, dimensions.y, dimensions.z*1/3, table.show(actors.topFrame));
+		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 0, 0, table[actors.topFrame]);
+		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_WIREFRAME, table[actors.topFrame]);
 	}
 
 	void setAcceleration(float setAcc)
@@ -142,11 +167,6 @@ struct Car
 			instructions.push_back(a);
 	}
 
-	void setUKF(UKF tracker)
-	{
-		ukf = tracker;
-	}
-
 	void move(float dt, int time_us)
 	{
 
@@ -160,6 +180,12 @@ struct Car
 			}
 		}
 
+		advance(dt);
+	}
+
+	// integrate the car's kinematics over dt with its current acceleration and steering
+	void advance(float dt)
+	{
 		position.x += velocity * cos(angle) * dt;
 		position.y += velocity * sin(angle) * dt;
 		angle += velocity*steering*dt/Lf;
@@ -171,12 +197,12 @@ struct Car
 	}
 
 	// collision helper function
-	bool inbetween(double point, double center, double range)
+	bool inbetween(double point, double center, double range) const
 	{
 		return (center - range <= point) && (center + range >= point);
 	}
 
-	bool checkCollision(Vect3 point)
+	bool checkCollision(const Vect3& point) const
 	{
 		// check collision for rotated car
 		double xPrime = ((point.x-position.x) * cosNegTheta - (point.y-position.y) * sinNegTheta)+position.x;
@@ -188,7 +214,7 @@ struct Car
 	}
 };
 
-void renderHighway(double distancePos, pcl::visualization::PCLVisualizer::Ptr& viewer);
+void renderHighway(double distancePos, pcl::visualization::PCLVisualizer::Ptr& viewer, RenderView* view = nullptr);
 void renderRays(pcl::visualization::PCLVisualizer::Ptr& viewer, const Vect3& origin, const pcl::PointCloud<pcl::PointXYZ>::Ptr& cloud);
 void clearRays(pcl::visualization::PCLVisualizer::Ptr& viewer);
 void renderPointCloud(pcl::visualization::PCLVisualizer::Ptr& viewer, const pcl::PointCloud<pcl::PointXYZ>::Ptr& cloud, std::string name, Color color = Color(1, 1, 1));
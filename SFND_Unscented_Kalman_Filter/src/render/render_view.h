@@ -0,0 +1,110 @@
+#ifndef RENDER_VIEW_H
+#define RENDER_VIEW_H
+#include <pcl/visualization/pcl_visualizer.h>
+#include "box.h"
+#include <algorithm>
+#include <cmath>
+
+// what one frame draws: shapes outside the camera's view are culled, far away shapes are drawn
+// with less detail or not at all, and the frame stops adding shapes once it has spent its budget.
+// A default view draws everything.
+struct RenderView
+{
+
+	// camera position and the inward normals of the four side planes of its view frustum.
+	// The near and far planes are left out, the viewer moves them to fit the scene.
+	bool culling;
+	double eye[3];
+	double planes[4][3];
+	// cars further away than this are drawn as a single box, poles further away aren't drawn
+	double boxOnlyDistance;
+	double poleDistance;
+	// shapes the frame may add, the viewer's cost per frame grows with the shape count
+	int maxShapes;
+	int shapes;
+
+	RenderView()
+		: culling(false), boxOnlyDistance(INFINITY), poleDistance(INFINITY), maxShapes(-1), shapes(0)
+	{
+		eye[0] = eye[1] = eye[2] = 0;
+	}
+
+	void setCamera(const pcl::visualization::Camera& camera)
+	{
+		double forward[3], up[3], right[3];
+		for(int i = 0; i < 3; i++)
+		{
+			eye[i] = camera.pos[i];
+			forward[i] = camera.focal[i]-camera.pos[i];
+		}
+		normalize(forward);
+		// up at right angles to forward
+		double along = camera.view[0]*forward[0] + camera.view[1]*forward[1] + camera.view[2]*forward[2];
+		for(int i = 0; i < 3; i++)
+			up[i] = camera.view[i]-along*forward[i];
+		normalize(up);
+		right[0] = forward[1]*up[2]-forward[2]*up[1];
+		right[1] = forward[2]*up[0]-forward[0]*up[2];
+		right[2] = forward[0]*up[1]-forward[1]*up[0];
+
+		double tanY = tan(camera.fovy/2);
+		double aspect = camera.window_size[1] > 0 ? camera.window_size[0]/camera.window_size[1] : 1;
+		double tanX = tanY*aspect;
+		for(int i = 0; i < 3; i++)
+		{
+			planes[0][i] = right[i] + forward[i]*tanX;
+			planes[1][i] = -right[i] + forward[i]*tanX;
+			planes[2][i] = up[i] + forward[i]*tanY;
+			planes[3][i] = -up[i] + forward[i]*tanY;
+		}
+		culling = true;
+	}
+
+	static void normalize(double v[3])
+	{
+		double length = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+		if(length > 0)
+		{
+			v[0] /= length;
+			v[1] /= length;
+			v[2] /= length;
+		}
+	}
+
+	// false if the box is completely outside the frustum
+	bool visible(const Box& box) const
+	{
+		if(!culling)
+			return true;
+		for(int p = 0; p < 4; p++)
+		{
+			// corner of the box furthest along the plane normal
+			double x = planes[p][0] >= 0 ? box.x_max : box.x_min;
+			double y = planes[p][1] >= 0 ? box.y_max : box.y_min;
+			double z = planes[p][2] >= 0 ? box.z_max : box.z_min;
+			if(planes[p][0]*(x-eye[0]) + planes[p][1]*(y-eye[1]) + planes[p][2]*(z-eye[2]) < 0)
+				return false;
+		}
+		return true;
+	}
+
+	// distance from the camera, 0 without one so everything gets full detail
+	double distance(double x, double y, double z) const
+	{
+		if(!culling)
+			return 0;
+		return sqrt((x-eye[0])*(x-eye[0]) + (y-eye[1])*(y-eye[1]) + (z-eye[2])*(z-eye[2]));
+	}
+
+	// spend count shapes of the budget, false once it is used up
+	bool take(int count)
+	{
+		if(maxShapes >= 0 && shapes+count > maxShapes)
+			return false;
+		shapes += count;
+		return true;
+	}
+
+};
+
+#endif
@@ -1,10 +1,18 @@
 #ifndef LIDAR_H
 #define LIDAR_H
 #include "../render/render.h"
+#include "lidar_profile.h"
+#include "traffic_view.h"
+#include "static_scene.h"
 #include <ctime>
 #include <chrono>
+#include <algorithm>
+#include <random>
 
-const double pi = 3.1415;
+// ground truth label of a simulated point: the index of the car it hit or one of these
+const int16_t LABEL_GROUND = -1;
+const int16_t LABEL_NONE = -2;
+const int16_t LABEL_STATIC = -3;
 
 struct Ray
 {
@@ -14,6 +22,9 @@ struct Ray
 	Vect3 direction;
 	Vect3 castPosition;
 	double castDistance;
+	// what the ray stopped on, and which static object if that is LABEL_STATIC, -1 otherwise
+	int16_t castLabel;
+	int castObject;
 
 	// parameters:
 	// setOrigin: the starting position from where the ray is cast
@@ -24,18 +35,35 @@ struct Ray
 
 	Ray(Vect3 setOrigin, double horizontalAngle, double verticalAngle, double setResolution)
 		: origin(setOrigin), resolution(setResolution), direction(resolution*cos(verticalAngle)*cos(horizontalAngle), resolution*cos(verticalAngle)*sin(horizontalAngle),resolution*sin(verticalAngle)),
-		  castPosition(origin), castDistance(0)
+		  castPosition(origin), castDistance(0), castLabel(LABEL_NONE), castObject(-1)
 	{}
 
-	void rayCast(const std::vector<Car>& cars, double minDistance, double maxDistance, pcl::PointCloud<pcl::PointXYZ>::Ptr& cloud, double slopeAngle, double sderr)
+	// unitDirection: normalized direction the ray travels in, as stored in a RayTable
+	Ray(const Vect3& setOrigin, const Vect3& unitDirection, double setResolution)
+		: origin(setOrigin), resolution(setResolution), direction(resolution*unitDirection.x, resolution*unitDirection.y, resolution*unitDirection.z),
+		  castPosition(origin), castDistance(0), castLabel(LABEL_NONE), castObject(-1)
+	{}
+
+	// keep the ray inside the rendered road window, wide enough for the poles beside the road
+	static bool inWindow(const Vect3& p)
+	{
+		return (p.y <= 11 && p.y >= -11 && p.x <= 50 && p.x >= -15);
+	}
+
+	// march the ray until it hits the ground slope, one of the cars, a static object or leaves the road window
+	// castPosition, castDistance and castLabel hold the end of the ray afterwards
+	// statics are looked up offset meters along the road, see StaticScene
+	void march(const TrafficView& cars, double maxDistance, double slopeAngle, const StaticScene* statics = nullptr, double offset = 0)
 	{
 		// reset ray
 		castPosition = origin;
 		castDistance = 0;
+		castLabel = LABEL_NONE;
+		castObject = -1;
 
 		bool collision = false;
 
-		while(!collision && castDistance < maxDistance && (castPosition.y <= 6 && castPosition.y >= -6 && castPosition.x <= 50 && castPosition.x >= -15))
+		while(!collision && castDistance < maxDistance && inWindow(castPosition))
 		{
 
 			castPosition = castPosition + direction;
@@ -43,47 +71,218 @@ struct Ray
 
 			// check if there is any collisions with ground slope
 			collision = (castPosition.z <= castPosition.x * tan(slopeAngle));
+			if(collision)
+				castLabel = LABEL_GROUND;
 
 			// check if there is any collisions with cars
 			if(!collision && castDistance < maxDistance)
 			{
-				for(Car car : cars)
+				int car = cars.firstCollision(castPosition);
+				collision = (car >= 0);
+				if(collision)
+					castLabel = (int16_t)car;
+			}
+
+			if(!collision && castDistance < maxDistance && statics)
+			{
+				castObject = statics->firstCollision(castPosition, offset);
+				collision = (castObject >= 0);
+				if(collision)
+					castLabel = LABEL_STATIC;
+			}
+		}
+	}
+
+	// true if the ray, marched out to distance, passes through the box
+	bool crosses(const Box& box, double distance) const
+	{
+		double steps = distance/resolution;
+		double d[3] = {direction.x*steps, direction.y*steps, direction.z*steps};
+		double o[3] = {origin.x, origin.y, origin.z};
+		double lo[3] = {box.x_min, box.y_min, box.z_min};
+		double hi[3] = {box.x_max, box.y_max, box.z_max};
+		// slab test of the segment origin -> origin+d against the box
+		double tEnter = 0, tExit = 1;
+		for(int axis = 0; axis < 3 && tEnter <= tExit; axis++)
+		{
+			if(fabs(d[axis]) < 1e-12)
+			{
+				if(o[axis] < lo[axis] || o[axis] > hi[axis])
+					return false;
+				continue;
+			}
+			double t0 = (lo[axis]-o[axis])/d[axis];
+			double t1 = (hi[axis]-o[axis])/d[axis];
+			if(t0 > t1)
+				std::swap(t0, t1);
+			tEnter = std::max(tEnter, t0);
+			tExit = std::min(tExit, t1);
+		}
+		return tEnter <= tExit;
+	}
+
+	bool crosses(const std::vector<Box>& boxes, double distance) const
+	{
+		for(const Box& box : boxes)
+		{
+			if(crosses(box, distance))
+				return true;
+		}
+		return false;
+	}
+
+	// same result as march(cars, ..., statics, offset) for a ray that stops at staticDistance on an empty road.
+	// All steps of the ray are tested against each car in one batch, and only cars whose
+	// bounding box the ray crosses are tested at all. The static objects along the ray come out of
+	// their hierarchy and are tested the same way. steps, hits, staticBoxes and staticObjects are scratch space.
+	void castThrough(const TrafficView& cars, const std::vector<Box>& carBoxes, const StaticScene* statics, double offset, double staticDistance, double maxDistance, double slopeAngle, PointBatch& steps, std::vector<uint8_t>& hits, std::vector<Box>& staticBoxes, std::vector<int>& staticObjects)
+	{
+		castPosition = origin;
+		castDistance = 0;
+		castObject = -1;
+		steps.clear();
+		// accumulate exactly like march so the positions match step for step
+		while(castDistance < staticDistance)
+		{
+			castPosition = castPosition + direction;
+			castDistance += resolution;
+			steps.push_back(castPosition);
+		}
+		// march doesn't test the cars on the step that hits the ground or reaches maxDistance
+		bool ground = (steps.size() > 0 && castPosition.z <= castPosition.x * tan(slopeAngle));
+		castLabel = ground ? LABEL_GROUND : LABEL_NONE;
+		size_t testable = steps.size();
+		if(testable > 0 && (castDistance >= maxDistance || ground))
+			testable--;
+
+		size_t first = testable;
+		for(size_t i = 0; i < cars.size(); i++)
+		{
+			if(!crosses(carBoxes[i], staticDistance))
+				continue;
+			cars.checkCollisions(i, steps, hits);
+			for(size_t k = 0; k < first; k++)
+			{
+				if(hits[k])
+				{
+					first = k;
+					castLabel = (int16_t)i;
+					break;
+				}
+			}
+		}
+		// cars win ties, march tests them first
+		if(statics && testable > 0)
+		{
+			statics->crossing(origin, steps[testable-1], offset, staticBoxes, &staticObjects);
+			for(size_t j = 0; j < staticBoxes.size(); j++)
+			{
+				const Box& box = staticBoxes[j];
+				for(size_t k = 0; k < first; k++)
 				{
-					collision |= car.checkCollision(castPosition);
-					if(collision)
+					if(StaticScene::contains(box, steps.x[k], steps.y[k], steps.z[k]))
+					{
+						first = k;
+						castLabel = LABEL_STATIC;
+						castObject = staticObjects[j];
 						break;
+					}
 				}
 			}
 		}
-
-		if((castDistance >= minDistance)&&(castDistance<=maxDistance)&& (castPosition.y <= 6 && castPosition.y >= -6 && castPosition.x <= 50 && castPosition.x >= -15))
+		if(first < testable)
 		{
-			// add noise based on standard deviation error
-			double rx = ((double) rand() / (RAND_MAX));
-			double ry = ((double) rand() / (RAND_MAX));
-			double rz = ((double) rand() / (RAND_MAX));
-			cloud->points.push_back(pcl::PointXYZ(castPosition.x+rx*sderr, castPosition.y+ry*sderr, castPosition.z+rz*sderr));
+			castPosition = steps[first];
+			// sum the distance up like march does
+			castDistance = 0;
+			for(size_t k = 0; k <= first; k++)
+				castDistance += resolution;
 		}
-			
 	}
 
+	// noise of up to sderr on each axis, drawn from the caller's generator so lidars can scan on separate threads
+	static void addPoint(const Vect3& position, float intensity, pcl::PointCloud<pcl::PointXYZI>::Ptr& cloud, double sderr, std::mt19937& generator)
+	{
+		std::uniform_real_distribution<double> unit(0.0, 1.0);
+		double rx = unit(generator);
+		double ry = unit(generator);
+		double rz = unit(generator);
+		pcl::PointXYZI point;
+		point.x = position.x+rx*sderr;
+		point.y = position.y+ry*sderr;
+		point.z = position.z+rz*sderr;
+		point.intensity = intensity;
+		cloud->points.push_back(point);
+	}
+
+};
+
+// result of the last cast of a ray, reused by incremental scans
+struct RayHit
+{
+	Vect3 position;
+	double distance;
+	int16_t label;
+	// static object the ray stopped on, -1 unless label is LABEL_STATIC
+	int object;
+	float intensity;
+	// how far the ray travels with no cars on the road, bounds the region a car can affect
+	double staticDistance;
+
+	RayHit()
+		: position(0,0,0), distance(0), label(LABEL_NONE), object(-1), intensity(0), staticDistance(0)
+	{}
 };
 
 struct Lidar
 {
 
-	std::vector<Ray> rays;
-	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud;
-	std::vector<Car> cars;
+	LidarProfile profile;
+	// looked up on the first scan so lidars that never scan don't build a table
+	std::shared_ptr<const RayTable> rayTable;
+	pcl::PointCloud<pcl::PointXYZI>::Ptr cloud;
+	// fire time of each cloud point in seconds after the scan started
+	std::vector<float> pointTimes;
+	// ground truth label of each cloud point, see LABEL_GROUND, LABEL_NONE and LABEL_STATIC
+	std::vector<int16_t> labels;
+	// live car poses owned by the scene, read on every scan
+	const TrafficView* cars;
+	// poles and guardrails owned by the scene, staticOffset is how far along the road the ego car is
+	const StaticScene* statics;
+	double staticOffset;
+	// speed the static scene passes the ego car at, moves it through rolling scans
+	double egoVelocity;
+	// mounting position and heading of the sensor relative to the ego car
 	Vect3 position;
+	double yaw;
 	double groundSlope;
 	double minDistance;
 	double maxDistance;
 	double resoultion;
 	double sderr;
+	// intensity model: a surface of reflectivity 1 hit head on at intensityRange returns 1,
+	// returns fall off with the square of the range and the cosine of the incidence angle
+	double groundReflectivity;
+	double intensityRange;
+	// reuse ray casts from the last scan for rays no car has moved across
+	bool incremental;
+	std::vector<RayHit> rayHits;
+	std::vector<Box> lastCarBoxes;
+	double lastStaticOffset;
+	// scratch space for batch ray casts
+	PointBatch raySteps;
+	std::vector<uint8_t> stepHits;
+	std::vector<Box> staticBoxes;
+	std::vector<int> staticObjects;
+	std::mt19937 noiseGenerator;
+	// print the time each scan takes
+	bool verbose;
+	// sweep the azimuth over scanPeriod seconds while the cars keep moving instead of taking a snapshot
+	bool rolling;
+	double scanPeriod;
 
-	Lidar(std::vector<Car> setCars, double setGroundSlope)
-		: cloud(new pcl::PointCloud<pcl::PointXYZ>()), position(0,0,3.0)
+	Lidar(const TrafficView& setCars, double setGroundSlope, const LidarProfile& setProfile = LidarProfile::named("hdl64"))
+		: profile(setProfile), cloud(new pcl::PointCloud<pcl::PointXYZI>()), position(0,0,3.0), yaw(0)
 	{
 		// TODO:: set minDistance to 5 to remove points from roof of ego car
 		minDistance = 0;
@@ -91,54 +290,260 @@ struct Lidar
 		resoultion = 0.2;
 		// TODO:: set sderr to 0.2 to get more interesting pcd files
 		sderr = 0.02;
-		cars = setCars;
+		groundReflectivity = 0.1;
+		intensityRange = 10;
+		incremental = true;
+		verbose = true;
+		rolling = false;
+		scanPeriod = 0.1;
+		cars = &setCars;
+		statics = nullptr;
+		staticOffset = 0;
+		lastStaticOffset = 0;
+		egoVelocity = 0;
 		groundSlope = setGroundSlope;
+	}
+
+	~Lidar()
+	{
+		// pcl uses boost smart pointers for cloud pointer so we don't have to worry about manually freeing the memory
+	}
 
-		// TODO:: increase number of layers to 8 to get higher resoultion pcd
-		int numLayers = 64;
-		// the steepest vertical angle
-		double steepestAngle =  24.8*(-pi/180);
-		double angleRange = 26.8*(pi/180);
-		// TODO:: set to pi/64 to get higher resoultion pcd
-		double horizontalAngleInc = pi/2250;
+	// move the sensor, cached ray casts no longer apply
+	void setExtrinsics(Vect3 setPosition, double setYaw)
+	{
+		position = setPosition;
+		yaw = setYaw;
+		rayHits.clear();
+	}
+
+	// observe a different scene
+	void observe(const TrafficView& setCars)
+	{
+		cars = &setCars;
+		rayHits.clear();
+	}
+
+	void observe(const StaticScene& setStatics)
+	{
+		statics = &setStatics;
+		rayHits.clear();
+	}
+
+	// the ego car moved along the road, only rays near static objects need a recast
+	void setStaticOffset(double offset)
+	{
+		staticOffset = offset;
+	}
 
-		double angleIncrement = angleRange/numLayers;
+	// volume each car swept since the last scan, padded by one ray step
+	// returns false if the cars can't be matched up with the last scan
+	bool sweepCars(std::vector<Box>& swept)
+	{
+		std::vector<Box> boxes;
+		for(size_t i = 0; i < cars->size(); i++)
+			boxes.push_back(cars->box(i));
+
+		bool matched = (boxes.size() == lastCarBoxes.size());
+		for(size_t i = 0; matched && i < boxes.size(); i++)
+		{
+			const Box& a = boxes[i];
+			const Box& b = lastCarBoxes[i];
+			// cars that haven't moved can't change any ray
+			if(a.x_min == b.x_min && a.x_max == b.x_max && a.y_min == b.y_min && a.y_max == b.y_max && a.z_min == b.z_min && a.z_max == b.z_max)
+				continue;
+			Box box;
+			box.x_min = std::min(a.x_min, b.x_min) - resoultion;
+			box.y_min = std::min(a.y_min, b.y_min) - resoultion;
+			box.z_min = std::min(a.z_min, b.z_min) - resoultion;
+			box.x_max = std::max(a.x_max, b.x_max) + resoultion;
+			box.y_max = std::max(a.y_max, b.y_max) + resoultion;
+			box.z_max = std::max(a.z_max, b.z_max) + resoultion;
+			swept.push_back(box);
+		}
+		lastCarBoxes = boxes;
+		return matched;
+	}
 
-		for(double angleVertical = steepestAngle; angleVertical < steepestAngle+angleRange; angleVertical+=angleIncrement)
+	// volume each static object near the road window swept through the ego frame since the last scan
+	void sweepStatics(std::vector<Box>& swept)
+	{
+		if(!statics || staticOffset == lastStaticOffset)
+			return;
+		double low = std::min(staticOffset, lastStaticOffset);
+		double high = std::max(staticOffset, lastStaticOffset);
+		// everything that was or is inside the window, in the world frame
+		Box region = StaticScene::makeBox(-15+low-resoultion, 50+high+resoultion, -11-resoultion, 11+resoultion, -1e9, 1e9);
+		std::vector<Box> objects;
+		statics->overlapping(region, objects);
+		double shift = high-low;
+		for(const Box& object : objects)
 		{
-			for(double angle = 0; angle <= 2*pi; angle+=horizontalAngleInc)
+			Box a = StaticScene::toEgo(object, staticOffset);
+			Box b = StaticScene::toEgo(object, lastStaticOffset);
+			Box box = StaticScene::merge(a, b);
+			box.x_min -= resoultion; box.y_min -= resoultion; box.z_min -= resoultion;
+			box.x_max += resoultion; box.y_max += resoultion; box.z_max += resoultion;
+			// an object longer than the shift only changed at its two ends, like the guardrails
+			if(shift < object.x_max-object.x_min)
 			{
-				Ray ray(position,angle,angleVertical,resoultion);
-				rays.push_back(ray);
+				Box back = box;
+				back.x_max = std::max(a.x_min, b.x_min) + resoultion;
+				Box front = box;
+				front.x_min = std::min(a.x_max, b.x_max) - resoultion;
+				swept.push_back(back);
+				swept.push_back(front);
 			}
+			else
+				swept.push_back(box);
 		}
 	}
 
-	~Lidar()
+	const RayTable& rays()
 	{
-		// pcl uses boost smart pointers for cloud pointer so we don't have to worry about manually freeing the memory
+		if(!rayTable)
+			rayTable = RayTable::get(profile);
+		return *rayTable;
+	}
+
+	// table direction turned by the sensor's mounting heading
+	Vect3 mountDirection(const Vect3& d, double cosYaw, double sinYaw) const
+	{
+		return Vect3(cosYaw*d.x - sinYaw*d.y, sinYaw*d.x + cosYaw*d.y, d.z);
+	}
+
+	// intensity of the return of a ray that was just cast, offset places the static scene
+	float intensity(const Ray& ray, const TrafficView& cars, double offset) const
+	{
+		double reflectivity = 0;
+		Vect3 normal(0, 0, 1);
+		if(ray.castLabel == LABEL_GROUND)
+		{
+			reflectivity = groundReflectivity;
+			normal = Vect3(-sin(groundSlope), 0, cos(groundSlope));
+		}
+		else if(ray.castLabel >= 0)
+		{
+			reflectivity = cars.reflectivity[ray.castLabel];
+			normal = cars.normal(ray.castLabel, ray.castPosition);
+		}
+		else if(ray.castLabel == LABEL_STATIC && ray.castObject >= 0)
+		{
+			// the object the cast stopped on, a static hit without one returns nothing
+			reflectivity = statics->reflectivity[ray.castObject];
+			normal = StaticScene::faceNormal(statics->objects[ray.castObject], Vect3(ray.castPosition.x+offset, ray.castPosition.y, ray.castPosition.z));
+		}
+		double range = std::max(ray.castDistance, ray.resolution);
+		double incidence = fabs(ray.direction.x*normal.x + ray.direction.y*normal.y + ray.direction.z*normal.z)/ray.resolution;
+		double falloff = intensityRange/range;
+		return std::min(1.0, reflectivity*incidence*falloff*falloff);
 	}
 
-	void updateCars(std::vector<Car> setCars)
+	bool inRange(double distance, const Vect3& hitPosition) const
 	{
-		cars = setCars;
+		return (distance >= minDistance) && (distance <= maxDistance) && Ray::inWindow(hitPosition);
 	}
 
-	pcl::PointCloud<pcl::PointXYZ>::Ptr scan()
+	pcl::PointCloud<pcl::PointXYZI>::Ptr scan()
 	{
  
 		cloud->points.clear();
+		pointTimes.clear();
+		labels.clear();
 		auto startTime = std::chrono::steady_clock::now();
-		for(Ray ray : rays)
-			ray.rayCast(cars, minDistance, maxDistance, cloud, groundSlope, sderr);
+
+		int recast = rolling ? scanRolling() : scanSnapshot();
+
 		auto endTime = std::chrono::steady_clock::now();
 		auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-		cout << "ray casting took " << elapsedTime.count() << " milliseconds" << endl;
+		if(verbose)
+			std::cout << "ray casting took " << elapsedTime.count() << " milliseconds, recast " << recast << " of " << rays().size() << " rays" << std::endl;
 		cloud->width = cloud->points.size();
 		cloud->height = 1; // one dimensional unorganized point cloud dataset
 		return cloud;
 	}
 
+	// every ray sees the cars where they are now, returns the number of rays cast
+	int scanSnapshot()
+	{
+		std::vector<Box> swept;
+		const std::vector<Vect3>& directions = rays().directions;
+		bool full = !sweepCars(swept) || !incremental || rayHits.size() != directions.size();
+		sweepStatics(swept);
+		lastStaticOffset = staticOffset;
+		if(full)
+			rayHits.assign(directions.size(), RayHit());
+
+		const TrafficView noCars;
+		double cosYaw = cos(yaw);
+		double sinYaw = sin(yaw);
+		int recast = 0;
+		for(size_t i = 0; i < directions.size(); i++)
+		{
+			Ray ray(position, mountDirection(directions[i], cosYaw, sinYaw), resoultion);
+			RayHit& hit = rayHits[i];
+			if(full)
+			{
+				ray.march(noCars, maxDistance, groundSlope);
+				hit.staticDistance = ray.castDistance;
+			}
+			// only rays passing through space a car moved in can have changed
+			if(full || ray.crosses(swept, hit.staticDistance))
+			{
+				ray.castThrough(*cars, lastCarBoxes, statics, staticOffset, hit.staticDistance, maxDistance, groundSlope, raySteps, stepHits, staticBoxes, staticObjects);
+				hit.position = ray.castPosition;
+				hit.distance = ray.castDistance;
+				hit.label = ray.castLabel;
+				hit.object = ray.castObject;
+				hit.intensity = intensity(ray, *cars, staticOffset);
+				recast++;
+			}
+			if(inRange(hit.distance, hit.position))
+			{
+				Ray::addPoint(hit.position, hit.intensity, cloud, sderr, noiseGenerator);
+				pointTimes.push_back(0);
+				labels.push_back(hit.label);
+			}
+		}
+		return recast;
+	}
+
+	// all beams of an azimuth step fire together, the cars are advanced between steps
+	// so moving cars come out smeared like on a real spinning sensor, returns the number of rays cast
+	int scanRolling()
+	{
+		const RayTable& table = rays();
+		const std::vector<Vect3>& directions = table.directions;
+		const int steps = table.profile.azimuthSteps;
+		const size_t beams = table.profile.elevations.size();
+		double stepTime = scanPeriod/steps;
+		double cosYaw = cos(yaw);
+		double sinYaw = sin(yaw);
+
+		TrafficView movingCars(*cars);
+		for(int step = 0; step < steps; step++)
+		{
+			if(step > 0)
+				movingCars.advance(stepTime);
+			double offset = staticOffset + egoVelocity*step*stepTime;
+			for(size_t beam = 0; beam < beams; beam++)
+			{
+				Ray ray(position, mountDirection(directions[beam*steps+step], cosYaw, sinYaw), resoultion);
+				ray.march(movingCars, maxDistance, groundSlope, statics, offset);
+				if(inRange(ray.castDistance, ray.castPosition))
+				{
+					Ray::addPoint(ray.castPosition, intensity(ray, movingCars, offset), cloud, sderr, noiseGenerator);
+					pointTimes.push_back(step*stepTime);
+					labels.push_back(ray.castLabel);
+				}
+			}
+		}
+
+		// the cached hits don't match the cars anymore
+		rayHits.clear();
+		return directions.size();
+	}
+
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,100 @@
+#ifndef LIDAR_PROFILE_H
+#define LIDAR_PROFILE_H
+#include "../render/render.h"
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// beam layout of a spinning lidar sensor
+struct LidarProfile
+{
+	std::string name;
+	// vertical angle of each beam in radians, 0 is along the xy plane
+	std::vector<double> elevations;
+	// number of firings per revolution, spread evenly over 2*pi
+	int azimuthSteps;
+
+	LidarProfile()
+		: azimuthSteps(0)
+	{}
+
+	LidarProfile(std::string setName, std::vector<double> setElevations, int setAzimuthSteps)
+		: name(setName), elevations(setElevations), azimuthSteps(setAzimuthSteps)
+	{}
+
+	// evenly spaced beams starting at the steepest angle, angles in degrees
+	static LidarProfile uniform(std::string setName, int numLayers, double steepestDeg, double rangeDeg, int setAzimuthSteps)
+	{
+		std::vector<double> setElevations;
+		for(int layer = 0; layer < numLayers; layer++)
+			setElevations.push_back((steepestDeg + rangeDeg*layer/numLayers)*M_PI/180);
+		return LidarProfile(setName, setElevations, setAzimuthSteps);
+	}
+
+	// named sensor profiles: vlp16, hdl32, hdl64, vls128
+	// unknown names fall back to hdl64
+	static LidarProfile named(const std::string& profileName)
+	{
+		if(profileName == "vlp16")
+			return uniform(profileName, 16, -15.0, 32.0, 1800);
+		if(profileName == "hdl32")
+			return uniform(profileName, 32, -30.67, 42.67, 2250);
+		if(profileName == "vls128")
+			return uniform(profileName, 128, -25.0, 40.0, 1800);
+		if(profileName != "hdl64")
+			std::cerr << "Unknown lidar profile " << profileName << ", using hdl64" << std::endl;
+		// layout the simulator always used, 64 layers from -24.8 deg over 26.8 deg at pi/2250 azimuth increments
+		return uniform("hdl64", 64, -24.8, 26.8, 4500);
+	}
+};
+
+// unit ray directions of a profile, computed once and shared by every lidar using the profile
+// ray i fires from beam i/azimuthSteps at azimuth step i%azimuthSteps
+struct RayTable
+{
+	LidarProfile profile;
+	std::vector<Vect3> directions;
+
+	RayTable(const LidarProfile& setProfile)
+		: profile(setProfile)
+	{
+		// every angle comes straight from its index so there is no accumulated rounding error
+		std::vector<double> cosAzimuth(profile.azimuthSteps), sinAzimuth(profile.azimuthSteps);
+		for(int step = 0; step < profile.azimuthSteps; step++)
+		{
+			double azimuth = 2*M_PI*step/profile.azimuthSteps;
+			cosAzimuth[step] = cos(azimuth);
+			sinAzimuth[step] = sin(azimuth);
+		}
+
+		directions.reserve(profile.elevations.size()*profile.azimuthSteps);
+		for(double elevation : profile.elevations)
+		{
+			double c = cos(elevation);
+			double s = sin(elevation);
+			for(int step = 0; step < profile.azimuthSteps; step++)
+				directions.push_back(Vect3(c*cosAzimuth[step], c*sinAzimuth[step], s));
+		}
+	}
+
+	size_t size() const
+	{
+		return directions.size();
+	}
+
+	// tables are cached by profile name, a profile with the same name but a different layout replaces the cached table
+	static std::shared_ptr<const RayTable> get(const LidarProfile& profile)
+	{
+		static std::mutex cacheMutex;
+		static std::map<std::string, std::shared_ptr<const RayTable> > cache;
+
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		std::shared_ptr<const RayTable>& table = cache[profile.name];
+		if(!table || table->profile.elevations != profile.elevations || table->profile.azimuthSteps != profile.azimuthSteps)
+			table = std::make_shared<const RayTable>(profile);
+		return table;
+	}
+};
+
+#endif
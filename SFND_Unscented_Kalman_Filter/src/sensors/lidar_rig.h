@@ -0,0 +1,204 @@
+#ifndef LIDAR_RIG_H
+#define LIDAR_RIG_H
+#include "lidar.h"
+#include "../track_pool.h"
+#include <thread>
+#include <unordered_map>
+#include <cstdint>
+
+// where a lidar sits on the ego car and which sensor it is
+struct LidarMount
+{
+	Vect3 position;
+	double yaw;
+	std::string profile;
+
+	LidarMount(Vect3 setPosition, double setYaw, std::string setProfile)
+		: position(setPosition), yaw(setYaw), profile(setProfile)
+	{}
+};
+
+// several lidars scanned in parallel and fused into one cloud
+struct LidarRig
+{
+
+	std::vector<std::unique_ptr<Lidar> > lidars;
+	pcl::PointCloud<pcl::PointXYZI>::Ptr cloud;
+	// fire time of each fused point in seconds after the scan started
+	std::vector<float> pointTimes;
+	// ground truth label of each fused point
+	std::vector<int16_t> labels;
+	// edge length of the voxels used to find points seen by more than one lidar
+	double voxelSize;
+	// ground the lidars see, deskew leaves points less than groundTolerance above it in place
+	double groundSlope;
+	double groundTolerance;
+	bool verbose;
+
+	LidarRig()
+		: cloud(new pcl::PointCloud<pcl::PointXYZI>()), voxelSize(0.2), groundSlope(0), groundTolerance(0.1), verbose(true)
+	{}
+
+	void addLidar(const TrafficView& cars, double setGroundSlope, const LidarMount& mount)
+	{
+		groundSlope = setGroundSlope;
+		std::unique_ptr<Lidar> lidar(new Lidar(cars, groundSlope, LidarProfile::named(mount.profile)));
+		lidar->setExtrinsics(mount.position, mount.yaw);
+		lidar->verbose = false;
+		// every mount draws its own noise, the first keeps the sequence of a lone lidar
+		lidar->noiseGenerator.seed(std::mt19937::default_seed + lidars.size());
+		lidars.push_back(std::move(lidar));
+	}
+
+	// poles and guardrails every lidar sees, the ego car passes them at egoVelocity
+	void observe(const StaticScene& statics, double egoVelocity)
+	{
+		for(std::unique_ptr<Lidar>& lidar : lidars)
+		{
+			lidar->observe(statics);
+			lidar->egoVelocity = egoVelocity;
+		}
+	}
+
+	void setStaticOffset(double offset)
+	{
+		for(std::unique_ptr<Lidar>& lidar : lidars)
+			lidar->setStaticOffset(offset);
+	}
+
+	// sweep every lidar over scanPeriod seconds while the cars keep moving, or take snapshots
+	void setRolling(bool rolling, double scanPeriod)
+	{
+		for(std::unique_ptr<Lidar>& lidar : lidars)
+		{
+			lidar->rolling = rolling;
+			lidar->scanPeriod = scanPeriod;
+		}
+	}
+
+	// pack the voxel coordinates of a point into one key, 21 bits per axis
+	uint64_t voxelKey(const pcl::PointXYZI& point) const
+	{
+		const int64_t offset = 1 << 20;
+		uint64_t x = (uint64_t)(int64_t(std::floor(point.x/voxelSize)) + offset) & 0x1FFFFF;
+		uint64_t y = (uint64_t)(int64_t(std::floor(point.y/voxelSize)) + offset) & 0x1FFFFF;
+		uint64_t z = (uint64_t)(int64_t(std::floor(point.z/voxelSize)) + offset) & 0x1FFFFF;
+		return (x << 42) | (y << 21) | z;
+	}
+
+	pcl::PointCloud<pcl::PointXYZI>::Ptr scan()
+	{
+		cloud->points.clear();
+		pointTimes.clear();
+		labels.clear();
+		auto startTime = std::chrono::steady_clock::now();
+
+		// every lidar scans into its own cloud, the shared ray tables are read only
+		std::vector<std::thread> workers;
+		for(size_t i = 1; i < lidars.size(); i++)
+			workers.push_back(std::thread([this, i]() { lidars[i]->scan(); }));
+		if(!lidars.empty())
+			lidars[0]->scan();
+		for(std::thread& worker : workers)
+			worker.join();
+
+		// keep a point unless another lidar already put a point in its voxel
+		size_t rawPoints = 0;
+		for(const std::unique_ptr<Lidar>& lidar : lidars)
+			rawPoints += lidar->cloud->points.size();
+		std::unordered_map<uint64_t, size_t> voxelOwner;
+		voxelOwner.reserve(rawPoints);
+		cloud->points.reserve(rawPoints);
+		pointTimes.reserve(rawPoints);
+		labels.reserve(rawPoints);
+		for(size_t i = 0; i < lidars.size(); i++)
+		{
+			const pcl::PointCloud<pcl::PointXYZI>::Ptr& lidarCloud = lidars[i]->cloud;
+			for(size_t j = 0; j < lidarCloud->points.size(); j++)
+			{
+				const pcl::PointXYZI& point = lidarCloud->points[j];
+				std::pair<std::unordered_map<uint64_t, size_t>::iterator, bool> owner = voxelOwner.insert(std::make_pair(voxelKey(point), i));
+				if(owner.second || owner.first->second == i)
+				{
+					cloud->points.push_back(point);
+					pointTimes.push_back(lidars[i]->pointTimes[j]);
+					labels.push_back(lidars[i]->labels[j]);
+				}
+			}
+		}
+
+		auto endTime = std::chrono::steady_clock::now();
+		auto elapsedTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
+		if(verbose && elapsedTime.count() > 0)
+			std::cout << lidars.size() << " lidars scanned " << rawPoints << " points (" << cloud->points.size() << " after merging) in " << elapsedTime.count()/1000 << " milliseconds, "
+				<< (long long)(rawPoints*1e6/elapsedTime.count()) << " points/s" << std::endl;
+		cloud->width = cloud->points.size();
+		cloud->height = 1; // one dimensional unorganized point cloud dataset
+		return cloud;
+	}
+
+	// undo the motion distortion of the last rolling scan: points that fall on a tracked car where
+	// its track's estimate puts it at the point's fire time are moved along the estimated velocity to
+	// where they would have been at referenceTime (seconds after the scan started). Ground returns
+	// and everything else are static and left in place.
+	void deskew(const std::vector<Car>& cars, const TrackPool& tracks, double referenceTime)
+	{
+		// tolerance around the estimated footprint for estimate error and the ray step
+		const double margin = 0.5;
+		for(size_t i = 0; i < cloud->points.size(); i++)
+		{
+			pcl::PointXYZI& point = cloud->points[i];
+			double height = point.z - point.x*tan(groundSlope);
+			if(height <= groundTolerance)
+				continue;
+			for(const Car& car : cars)
+			{
+				if(car.track < 0 || !tracks[car.track].IsInitialized())
+					continue;
+				const UKF::StateVector& x = tracks[car.track].x_;
+				double v = x(2);
+				double yaw = x(3);
+				double vx = v*cos(yaw);
+				double vy = v*sin(yaw);
+				// point in the estimated car frame at its fire time
+				double dx = point.x - (x(0) + vx*pointTimes[i]);
+				double dy = point.y - (x(1) + vy*pointTimes[i]);
+				double along = dx*cos(yaw) + dy*sin(yaw);
+				double across = -dx*sin(yaw) + dy*cos(yaw);
+				if(fabs(along) <= car.dimensions.x/2 + margin && fabs(across) <= car.dimensions.y/2 + margin && height <= car.dimensions.z + margin)
+				{
+					double dt = referenceTime - pointTimes[i];
+					point.x += vx*dt;
+					point.y += vy*dt;
+					break;
+				}
+			}
+		}
+	}
+
+	// fraction of the points whose ground truth label is a car that lie on that car's footprint in
+	// cars, padded by margin for the sensor noise. After a rolling scan is deskewed to the time cars
+	// was taken at, the points on moving cars should be back on their boxes. -1 without car points.
+	double onCarFraction(const TrafficView& cars, double margin) const
+	{
+		size_t carPoints = 0, onCar = 0;
+		for(size_t i = 0; i < cloud->points.size(); i++)
+		{
+			int car = labels[i];
+			if(car < 0 || car >= (int)cars.size())
+				continue;
+			const pcl::PointXYZI& point = cloud->points[i];
+			double dx = point.x - cars.x[car];
+			double dy = point.y - cars.y[car];
+			double along = dx*cars.cosNegTheta[car] - dy*cars.sinNegTheta[car];
+			double across = dy*cars.cosNegTheta[car] + dx*cars.sinNegTheta[car];
+			carPoints++;
+			if(fabs(along) <= cars.length[car]/2 + margin && fabs(across) <= cars.width[car]/2 + margin)
+				onCar++;
+		}
+		return carPoints > 0 ? (double)onCar/carPoints : -1;
+	}
+
+};
+
+#endif
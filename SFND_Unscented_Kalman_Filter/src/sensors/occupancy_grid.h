@@ -0,0 +1,244 @@
+#ifndef OCCUPANCY_GRID_H
+#define OCCUPANCY_GRID_H
+#include "../render/render.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+
+// 2D log odds occupancy grid on the road plane in the world frame, updated from lidar scans.
+// The grid is a window that rolls along the road with the ego car: columns are stored in a
+// ring so moving the window only clears the columns that enter it.
+struct OccupancyGrid
+{
+
+	// cell edge length and window size in meters, the window reaches behind and ahead of the ego car
+	double cellSize;
+	double lengthBehind;
+	double lengthAhead;
+	double halfWidth;
+	int columns, rows;
+	// world cell index of the first column in the window
+	long long firstColumn;
+	// log odds of every cell, column major in ring order
+	std::vector<float> logOdds;
+	// log odds added for a cell a ray ends in and a cell a ray passes through, and the clamp range
+	float logHit, logMiss, logMin, logMax;
+	// points lower than this are returns from the road and only clear the cells on the way
+	double obstacleHeight;
+	// threads share out the rays by azimuth sector
+	int threads;
+	int sectorsPerThread;
+
+	// what the last scan saw in each cell, one mask per thread so threads never write the same memory.
+	// TRACED marks end cells whose ray was already walked, points ending in the same cell share one ray.
+	enum { UNSEEN = 0, FREE = 1, HIT = 2, TRACED = 4 };
+	std::vector<std::vector<uint8_t> > masks;
+	// points of each azimuth sector, kept between scans to reuse the memory
+	std::vector<std::vector<size_t> > sectorPoints;
+
+	OccupancyGrid(double setCellSize = 0.2, double setLengthBehind = 20, double setLengthAhead = 60, double setHalfWidth = 20)
+		: cellSize(setCellSize), lengthBehind(setLengthBehind), lengthAhead(setLengthAhead), halfWidth(setHalfWidth),
+		  firstColumn(0), logHit(0.85), logMiss(-0.4), logMin(-2), logMax(3.5), obstacleHeight(0.3), sectorsPerThread(4)
+	{
+		columns = std::ceil((lengthBehind+lengthAhead)/cellSize);
+		rows = std::ceil(2*halfWidth/cellSize);
+		logOdds.assign((size_t)columns*rows, 0);
+		threads = std::max(1u, std::min(8u, std::thread::hardware_concurrency()));
+		firstColumn = std::floor(-lengthBehind/cellSize);
+	}
+
+	long long worldColumn(double x) const
+	{
+		return std::floor(x/cellSize);
+	}
+
+	int row(double y) const
+	{
+		return std::floor((y+halfWidth)/cellSize);
+	}
+
+	// storage index of a cell, the caller checks it is inside the window
+	size_t index(long long column, int cellRow) const
+	{
+		long long ring = column % columns;
+		if(ring < 0)
+			ring += columns;
+		return (size_t)ring*rows + cellRow;
+	}
+
+	bool inside(long long column, int cellRow) const
+	{
+		return column >= firstColumn && column < firstColumn+columns && cellRow >= 0 && cellRow < rows;
+	}
+
+	// move the window along with the ego car at world position x along the road
+	void follow(double egoX)
+	{
+		long long newFirst = worldColumn(egoX-lengthBehind);
+		if(newFirst == firstColumn)
+			return;
+		// columns that left the window are reused for the ones entering it, which start unknown
+		long long begin = newFirst > firstColumn ? std::max(firstColumn+columns, newFirst) : newFirst;
+		long long end = newFirst > firstColumn ? newFirst+columns : std::min(firstColumn, newFirst+columns);
+		for(long long column = begin; column < end; column++)
+			std::fill(logOdds.begin()+index(column, 0), logOdds.begin()+index(column, 0)+rows, 0.0f);
+		firstColumn = newFirst;
+	}
+
+	// add a scan taken by a sensor at origin, both in the ego frame. offset is how far along the
+	// road the ego car is, the same offset the lidar sees the static scene at.
+	void update(const pcl::PointCloud<pcl::PointXYZI>& cloud, const Vect3& origin, double offset)
+	{
+		size_t cells = logOdds.size();
+		masks.resize(threads);
+		int sectors = threads*sectorsPerThread;
+
+		// rays of neighbouring azimuths pass through neighbouring cells, so each thread walks whole
+		// sectors and keeps its cache lines to itself. Sector s belongs to thread s % threads.
+		sectorPoints.resize(sectors);
+		for(std::vector<size_t>& points : sectorPoints)
+			points.clear();
+		for(size_t i = 0; i < cloud.points.size(); i++)
+		{
+			const pcl::PointXYZI& point = cloud.points[i];
+			int sector = std::min(sectors-1, (int)(diamondAngle(point.x-origin.x, point.y-origin.y)/4*sectors));
+			sectorPoints[sector].push_back(i);
+		}
+
+		auto trace = [&](int thread)
+		{
+			std::vector<uint8_t>& mask = masks[thread];
+			mask.assign(cells, UNSEEN);
+			for(int sector = thread; sector < sectors; sector += threads)
+			{
+				for(size_t i : sectorPoints[sector])
+				{
+					const pcl::PointXYZI& point = cloud.points[i];
+					double x = point.x+offset;
+					long long column = worldColumn(x);
+					int cellRow = row(point.y);
+					uint8_t end = point.z > obstacleHeight ? HIT : FREE;
+					if(!inside(column, cellRow))
+					{
+						traceRay(origin.x+offset, origin.y, x, point.y, end, mask);
+						continue;
+					}
+					uint8_t& cell = mask[index(column, cellRow)];
+					cell |= end;
+					if(cell & TRACED)
+						continue;
+					cell |= TRACED;
+					// walk to the cell center so every point in the cell shares the ray
+					traceRay(origin.x+offset, origin.y, (column+0.5)*cellSize, (cellRow+0.5)*cellSize-halfWidth, end, mask);
+				}
+			}
+		};
+		std::vector<std::thread> workers;
+		for(int thread = 1; thread < threads; thread++)
+			workers.push_back(std::thread(trace, thread));
+		trace(0);
+		for(std::thread& worker : workers)
+			worker.join();
+
+		// fold the masks into the log odds, a hit in any mask wins over free.
+		// Threads split the cells into blocks, the inner loops have no branches.
+		auto fold = [&](size_t begin, size_t end)
+		{
+			float* odds = logOdds.data();
+			for(size_t k = begin; k < end; k++)
+			{
+				uint8_t seen = UNSEEN;
+				for(int thread = 0; thread < threads; thread++)
+					seen |= masks[thread][k];
+				bool hit = (seen & HIT) != 0;
+				bool free = !hit && (seen & FREE);
+				float value = odds[k] + hit*logHit + free*logMiss;
+				odds[k] = std::min(logMax, std::max(logMin, value));
+			}
+		};
+		workers.clear();
+		size_t block = (cells+threads-1)/threads;
+		for(int thread = 1; thread < threads; thread++)
+			workers.push_back(std::thread(fold, std::min(cells, thread*block), std::min(cells, (thread+1)*block)));
+		fold(0, std::min(cells, block));
+		for(std::thread& worker : workers)
+			worker.join();
+	}
+
+	// stand in for the azimuth in [0, 4) that grows with it like atan2 does, without the trigonometry
+	static double diamondAngle(double dx, double dy)
+	{
+		double sum = fabs(dx)+fabs(dy);
+		if(sum == 0)
+			return 0;
+		if(dy >= 0)
+			return dx >= 0 ? dy/sum : 1-dx/sum;
+		return dx < 0 ? 2-dy/sum : 3+dx/sum;
+	}
+
+	// walk the cells from (x0, y0) to (x1, y1) in world meters with a DDA, every cell on the way
+	// is free and the last one gets end, HIT if the ray ended on an obstacle. Stops when it leaves the window.
+	void traceRay(double x0, double y0, double x1, double y1, uint8_t end, std::vector<uint8_t>& mask) const
+	{
+		// ray in cell units relative to the window
+		double ax = x0/cellSize, ay = (y0+halfWidth)/cellSize;
+		double bx = x1/cellSize, by = (y1+halfWidth)/cellSize;
+		long long column = std::floor(ax);
+		int cellRow = std::floor(ay);
+		long long endColumn = std::floor(bx);
+		int endRow = std::floor(by);
+		double dx = bx-ax, dy = by-ay;
+		int stepX = dx > 0 ? 1 : -1;
+		int stepY = dy > 0 ? 1 : -1;
+		// distance along the ray, in units of the whole ray, between column and row crossings
+		double deltaX = dx != 0 ? fabs(1/dx) : INFINITY;
+		double deltaY = dy != 0 ? fabs(1/dy) : INFINITY;
+		double nextX = dx != 0 ? (stepX > 0 ? (column+1-ax) : (ax-column))*deltaX : INFINITY;
+		double nextY = dy != 0 ? (stepY > 0 ? (cellRow+1-ay) : (ay-cellRow))*deltaY : INFINITY;
+		// a ray crosses one cell border per step, so it takes this many steps to reach the end cell
+		long long steps = std::llabs(endColumn-column) + std::abs(endRow-cellRow);
+		// walk the window column and the ring column along so the loop needs no division
+		long long local = column-firstColumn;
+		long long ring = index(column, 0)/rows;
+		uint8_t* cells = mask.data();
+		for(long long k = 0; k < steps; k++)
+		{
+			if(local < 0 || local >= columns || cellRow < 0 || cellRow >= rows)
+				return;
+			cells[ring*rows + cellRow] |= FREE;
+			if(nextX < nextY)
+			{
+				local += stepX;
+				ring += stepX;
+				ring = ring == columns ? 0 : (ring < 0 ? columns-1 : ring);
+				nextX += deltaX;
+			}
+			else
+			{
+				cellRow += stepY;
+				nextY += deltaY;
+			}
+		}
+		if(inside(endColumn, endRow))
+			cells[index(endColumn, endRow)] |= end;
+	}
+
+	// occupancy probability of the cell under a point in the ego frame, 0.5 outside the window
+	double probability(double x, double y, double offset) const
+	{
+		long long column = worldColumn(x+offset);
+		int cellRow = row(y);
+		if(!inside(column, cellRow))
+			return 0.5;
+		return 1 - 1/(1+exp(logOdds[index(column, cellRow)]));
+	}
+
+	bool isFree(double x, double y, double offset, double threshold = 0.3) const
+	{
+		return probability(x, y, offset) < threshold;
+	}
+
+};
+
+#endif
@@ -0,0 +1,304 @@
+#ifndef STATIC_SCENE_H
+#define STATIC_SCENE_H
+#include "../render/render.h"
+#include <algorithm>
+
+// objects next to the highway that never move in the world frame, poles and guardrails.
+// They are built once into a bounding volume hierarchy so ray casts only look at the
+// few objects near the ray. The ego car drives along x, so a point in the ego frame is at
+// x + offset in the world frame, with offset the distance the ego car has travelled.
+struct StaticScene
+{
+
+	struct Node
+	{
+		Box bounds;
+		// children for inner nodes, object range [first, first+count) for leaves
+		int left, right;
+		int first, count;
+	};
+
+	// axis aligned boxes in the world frame, reordered while building so every leaf owns a range
+	std::vector<Box> objects;
+	// fraction of a lidar beam each object sends back
+	std::vector<float> reflectivity;
+	std::vector<Node> nodes;
+
+	static const int leafSize = 2;
+
+	// poles and guardrails along the highway from x = start to x = end, poles are spaced from
+	// start like renderHighway spaces them from the back of the road
+	static StaticScene highway(double start, double end)
+	{
+		// units in meters, same as renderHighway
+		double roadWidth = 12.0;
+		double poleSpace = 10;
+		double poleCurve = 4;
+		double poleWidth = 0.5;
+		double poleHeight = 3;
+		// guardrail beam along the road edge, one box per side so it looks the same wherever the ego car is
+		double railWidth = 0.2;
+		double railBottom = 0.4;
+		double railTop = 0.8;
+		// painted poles, retroreflectors on the guardrails
+		float poleReflectivity = 0.5;
+		float railReflectivity = 0.9;
+
+		StaticScene scene;
+		for(double markerPos = start; markerPos <= end; markerPos += poleSpace)
+		{
+			for(int side = -1; side <= 1; side += 2)
+			{
+				double y = side*(roadWidth/2+poleCurve);
+				scene.add(makeBox(markerPos-poleWidth/2, markerPos+poleWidth/2, y-poleWidth/2, y+poleWidth/2, 0, poleHeight), poleReflectivity);
+			}
+		}
+		scene.add(makeBox(start, end, roadWidth/2, roadWidth/2+railWidth, railBottom, railTop), railReflectivity);
+		scene.add(makeBox(start, end, -roadWidth/2-railWidth, -roadWidth/2, railBottom, railTop), railReflectivity);
+		scene.build();
+		return scene;
+	}
+
+	// add an object, call build afterwards
+	void add(const Box& box, float setReflectivity)
+	{
+		objects.push_back(box);
+		reflectivity.push_back(setReflectivity);
+	}
+
+	static Box makeBox(double xMin, double xMax, double yMin, double yMax, double zMin, double zMax)
+	{
+		Box box;
+		box.x_min = xMin; box.x_max = xMax;
+		box.y_min = yMin; box.y_max = yMax;
+		box.z_min = zMin; box.z_max = zMax;
+		return box;
+	}
+
+	static Box merge(const Box& a, const Box& b)
+	{
+		return makeBox(std::min(a.x_min, b.x_min), std::max(a.x_max, b.x_max), std::min(a.y_min, b.y_min), std::max(a.y_max, b.y_max), std::min(a.z_min, b.z_min), std::max(a.z_max, b.z_max));
+	}
+
+	static bool contains(const Box& box, double x, double y, double z)
+	{
+		return x >= box.x_min && x <= box.x_max && y >= box.y_min && y <= box.y_max && z >= box.z_min && z <= box.z_max;
+	}
+
+	void build()
+	{
+		nodes.clear();
+		if(objects.empty())
+			return;
+		std::vector<int> order(objects.size());
+		for(size_t i = 0; i < order.size(); i++)
+			order[i] = i;
+		buildNode(order, 0, objects.size());
+		// lay the objects out in leaf order
+		std::vector<Box> sortedObjects;
+		std::vector<float> sortedReflectivity;
+		for(int i : order)
+		{
+			sortedObjects.push_back(objects[i]);
+			sortedReflectivity.push_back(reflectivity[i]);
+		}
+		objects.swap(sortedObjects);
+		reflectivity.swap(sortedReflectivity);
+	}
+
+	// split objects order[first, first+count) at the median of the longest axis
+	int buildNode(std::vector<int>& order, int first, int count)
+	{
+		Box bounds = objects[order[first]];
+		for(int i = first+1; i < first+count; i++)
+			bounds = merge(bounds, objects[order[i]]);
+
+		int index = nodes.size();
+		Node node;
+		node.bounds = bounds;
+		node.left = node.right = -1;
+		node.first = first;
+		node.count = count;
+		nodes.push_back(node);
+		if(count <= leafSize)
+			return index;
+
+		double extent[3] = {bounds.x_max-bounds.x_min, bounds.y_max-bounds.y_min, bounds.z_max-bounds.z_min};
+		int axis = std::max_element(extent, extent+3) - extent;
+		std::vector<int>::iterator begin = order.begin()+first;
+		std::nth_element(begin, begin+count/2, begin+count, [this, axis](int a, int b)
+		{
+			return center(objects[a], axis) < center(objects[b], axis);
+		});
+		int left = buildNode(order, first, count/2);
+		int right = buildNode(order, first+count/2, count-count/2);
+		nodes[index].left = left;
+		nodes[index].right = right;
+		nodes[index].count = 0;
+		return index;
+	}
+
+	static double center(const Box& box, int axis)
+	{
+		if(axis == 0)
+			return (box.x_min+box.x_max)/2;
+		if(axis == 1)
+			return (box.y_min+box.y_max)/2;
+		return (box.z_min+box.z_max)/2;
+	}
+
+	// true if the ego frame point lies inside any object
+	bool checkCollision(const Vect3& point, double offset) const
+	{
+		return firstCollision(point, offset) >= 0;
+	}
+
+	// index of an object containing the ego frame point, -1 if there is none
+	int firstCollision(const Vect3& point, double offset) const
+	{
+		if(nodes.empty())
+			return -1;
+		double x = point.x + offset;
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while(top > 0)
+		{
+			const Node& node = nodes[stack[--top]];
+			if(!contains(node.bounds, x, point.y, point.z))
+				continue;
+			if(node.left < 0)
+			{
+				for(int i = node.first; i < node.first+node.count; i++)
+				{
+					if(contains(objects[i], x, point.y, point.z))
+						return i;
+				}
+			}
+			else
+			{
+				stack[top++] = node.left;
+				stack[top++] = node.right;
+			}
+		}
+		return -1;
+	}
+
+	// outward normal of the box face closest to a point inside or on the box
+	static Vect3 faceNormal(const Box& box, const Vect3& point)
+	{
+		double gaps[6] = {point.x-box.x_min, box.x_max-point.x, point.y-box.y_min, box.y_max-point.y, point.z-box.z_min, box.z_max-point.z};
+		int face = std::min_element(gaps, gaps+6) - gaps;
+		double sign = (face % 2) ? 1 : -1;
+		return Vect3(face/2 == 0 ? sign : 0, face/2 == 1 ? sign : 0, face/2 == 2 ? sign : 0);
+	}
+
+	// slab test of the segment from -> to against a box
+	static bool segmentCrosses(const Box& box, const double from[3], const double to[3])
+	{
+		double lo[3] = {box.x_min, box.y_min, box.z_min};
+		double hi[3] = {box.x_max, box.y_max, box.z_max};
+		double tEnter = 0, tExit = 1;
+		for(int axis = 0; axis < 3; axis++)
+		{
+			double d = to[axis]-from[axis];
+			if(fabs(d) < 1e-12)
+			{
+				if(from[axis] < lo[axis] || from[axis] > hi[axis])
+					return false;
+				continue;
+			}
+			double t0 = (lo[axis]-from[axis])/d;
+			double t1 = (hi[axis]-from[axis])/d;
+			if(t0 > t1)
+				std::swap(t0, t1);
+			tEnter = std::max(tEnter, t0);
+			tExit = std::min(tExit, t1);
+			if(tEnter > tExit)
+				return false;
+		}
+		return true;
+	}
+
+	// objects the ego frame segment from -> to passes through, as ego frame boxes,
+	// and their indices into objects if indices isn't null
+	void crossing(const Vect3& from, const Vect3& to, double offset, std::vector<Box>& out, std::vector<int>* indices = nullptr) const
+	{
+		out.clear();
+		if(indices)
+			indices->clear();
+		if(nodes.empty())
+			return;
+		double a[3] = {from.x+offset, from.y, from.z};
+		double b[3] = {to.x+offset, to.y, to.z};
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while(top > 0)
+		{
+			const Node& node = nodes[stack[--top]];
+			if(!segmentCrosses(node.bounds, a, b))
+				continue;
+			if(node.left < 0)
+			{
+				for(int i = node.first; i < node.first+node.count; i++)
+				{
+					if(segmentCrosses(objects[i], a, b))
+					{
+						out.push_back(toEgo(objects[i], offset));
+						if(indices)
+							indices->push_back(i);
+					}
+				}
+			}
+			else
+			{
+				stack[top++] = node.left;
+				stack[top++] = node.right;
+			}
+		}
+	}
+
+	// world frame objects overlapping the world frame region
+	void overlapping(const Box& region, std::vector<Box>& out) const
+	{
+		out.clear();
+		if(nodes.empty())
+			return;
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while(top > 0)
+		{
+			const Node& node = nodes[stack[--top]];
+			if(!overlaps(node.bounds, region))
+				continue;
+			if(node.left < 0)
+			{
+				for(int i = node.first; i < node.first+node.count; i++)
+				{
+					if(overlaps(objects[i], region))
+						out.push_back(objects[i]);
+				}
+			}
+			else
+			{
+				stack[top++] = node.left;
+				stack[top++] = node.right;
+			}
+		}
+	}
+
+	static bool overlaps(const Box& a, const Box& b)
+	{
+		return a.x_min <= b.x_max && a.x_max >= b.x_min && a.y_min <= b.y_max && a.y_max >= b.y_min && a.z_min <= b.z_max && a.z_max >= b.z_min;
+	}
+
+	static Box toEgo(const Box& box, double offset)
+	{
+		return makeBox(box.x_min-offset, box.x_max-offset, box.y_min, box.y_max, box.z_min, box.z_max);
+	}
+
+};
+
+#endif
@@ -0,0 +1,221 @@
+#ifndef TRAFFIC_VIEW_H
+#define TRAFFIC_VIEW_H
+#include "../render/render.h"
+#include <cmath>
+#include <cstdint>
+
+// points laid out as flat arrays for batch queries
+struct PointBatch
+{
+
+	std::vector<double> x, y, z;
+
+	size_t size() const
+	{
+		return x.size();
+	}
+
+	void clear()
+	{
+		x.clear(); y.clear(); z.clear();
+	}
+
+	void push_back(const Vect3& point)
+	{
+		x.push_back(point.x);
+		y.push_back(point.y);
+		z.push_back(point.z);
+	}
+
+	Vect3 operator[](size_t k) const
+	{
+		return Vect3(x[k], y[k], z[k]);
+	}
+};
+
+// pose and kinematic state of every car laid out as flat arrays, the only part of the
+// scene the sensors need. Refreshed from the cars once per frame so sensors read the live
+// scene without copying Car objects and the UKFs inside them.
+struct TrafficView
+{
+
+	std::vector<double> x, y, z;
+	std::vector<double> length, width, height;
+	std::vector<double> angle, sinNegTheta, cosNegTheta;
+	std::vector<double> velocity, acceleration, steering, Lf;
+	// fraction of a lidar beam the paint sends back, brighter colors reflect more
+	std::vector<double> reflectivity;
+
+	size_t size() const
+	{
+		return x.size();
+	}
+
+	void refresh(const std::vector<Car>& cars)
+	{
+		size_t n = cars.size();
+		x.resize(n); y.resize(n); z.resize(n);
+		length.resize(n); width.resize(n); height.resize(n);
+		angle.resize(n); sinNegTheta.resize(n); cosNegTheta.resize(n);
+		velocity.resize(n); acceleration.resize(n); steering.resize(n); Lf.resize(n);
+		reflectivity.resize(n);
+		for(size_t i = 0; i < n; i++)
+		{
+			const Car& car = cars[i];
+			x[i] = car.position.x;
+			y[i] = car.position.y;
+			z[i] = car.position.z;
+			length[i] = car.dimensions.x;
+			width[i] = car.dimensions.y;
+			height[i] = car.dimensions.z;
+			angle[i] = car.angle;
+			sinNegTheta[i] = car.sinNegTheta;
+			cosNegTheta[i] = car.cosNegTheta;
+			velocity[i] = car.velocity;
+			acceleration[i] = car.acceleration;
+			steering[i] = car.steering;
+			Lf[i] = car.Lf;
+			reflectivity[i] = 0.1 + 0.8*(car.color.r + car.color.g + car.color.b)/3;
+		}
+	}
+
+	// same kinematics as Car::advance, used to move a copy of the view through a rolling scan
+	void advance(double dt)
+	{
+		for(size_t i = 0; i < size(); i++)
+		{
+			x[i] += velocity[i] * cos(angle[i]) * dt;
+			y[i] += velocity[i] * sin(angle[i]) * dt;
+			angle[i] += velocity[i]*steering[i]*dt/Lf[i];
+			velocity[i] += acceleration[i]*dt;
+			sinNegTheta[i] = sin(-angle[i]);
+			cosNegTheta[i] = cos(-angle[i]);
+		}
+	}
+
+	// same test as Car::checkCollision for car i
+	bool checkCollision(size_t i, const Vect3& point) const
+	{
+		// check collision for rotated car
+		double dx = point.x-x[i];
+		double dy = point.y-y[i];
+		double xPrime = dx * cosNegTheta[i] - dy * sinNegTheta[i];
+		double yPrime = dy * cosNegTheta[i] + dx * sinNegTheta[i];
+		double zPrime = point.z-z[i];
+
+		return (fabs(yPrime) <= width[i] / 2) &&
+			((fabs(xPrime) <= length[i] / 2 && zPrime >= 0 && zPrime <= height[i] * 2 / 3) ||
+			 (fabs(xPrime) <= length[i] / 4 && zPrime >= height[i] * 2 / 3 && zPrime <= height[i]));
+	}
+
+	bool checkCollision(const Vect3& point) const
+	{
+		return firstCollision(point) >= 0;
+	}
+
+	// index of the first car containing point, -1 if there is none
+	int firstCollision(const Vect3& point) const
+	{
+		for(size_t i = 0; i < size(); i++)
+		{
+			if(checkCollision(i, point))
+				return i;
+		}
+		return -1;
+	}
+
+	// batch version of checkCollision(i, point): hit[k] is 1 if point k is inside car i.
+	// The loop has no branches so the compiler can test several points per instruction.
+	void checkCollisions(size_t i, const PointBatch& points, std::vector<uint8_t>& hit) const
+	{
+		size_t n = points.size();
+		hit.resize(n);
+		const double* px = points.x.data();
+		const double* py = points.y.data();
+		const double* pz = points.z.data();
+		uint8_t* h = hit.data();
+		const double cx = x[i], cy = y[i], cz = z[i];
+		const double c = cosNegTheta[i], s = sinNegTheta[i];
+		const double halfLength = length[i]/2, quarterLength = length[i]/4, halfWidth = width[i]/2;
+		const double bodyTop = height[i]*2/3, roofTop = height[i];
+		for(size_t k = 0; k < n; k++)
+		{
+			double dx = px[k]-cx;
+			double dy = py[k]-cy;
+			double xPrime = fabs(dx * c - dy * s);
+			double yPrime = fabs(dy * c + dx * s);
+			double zPrime = pz[k]-cz;
+			uint8_t body = (xPrime <= halfLength) & (zPrime >= 0) & (zPrime <= bodyTop);
+			uint8_t roof = (xPrime <= quarterLength) & (zPrime >= bodyTop) & (zPrime <= roofTop);
+			h[k] = (yPrime <= halfWidth) & (body | roof);
+		}
+	}
+
+	// batch version of checkCollision(point) against every car: hit[k] is 1 if point k is
+	// inside any car and car[k] is the lowest index of a car containing it, -1 for none
+	void checkCollisions(const PointBatch& points, std::vector<uint8_t>& hit, std::vector<int>& car) const
+	{
+		size_t n = points.size();
+		hit.assign(n, 0);
+		car.assign(n, -1);
+		std::vector<uint8_t> carHit;
+		// later cars first so the lowest index is written last
+		for(size_t i = size(); i-- > 0; )
+		{
+			checkCollisions(i, points, carHit);
+			for(size_t k = 0; k < n; k++)
+			{
+				hit[k] |= carHit[k];
+				car[k] = carHit[k] ? (int)i : car[k];
+			}
+		}
+	}
+
+	// outward normal of the face of car i closest to a point inside it, a stand in for the
+	// surface a lidar beam stopping at the point hit
+	Vect3 normal(size_t i, const Vect3& point) const
+	{
+		double dx = point.x-x[i];
+		double dy = point.y-y[i];
+		double xPrime = dx * cosNegTheta[i] - dy * sinNegTheta[i];
+		double yPrime = dy * cosNegTheta[i] + dx * sinNegTheta[i];
+		double zPrime = point.z-z[i];
+		// the roof is half as long as the body below it
+		bool roof = zPrime > height[i]*2/3;
+		double halfLength = roof ? length[i]/4 : length[i]/2;
+		double top = roof ? height[i] : height[i]*2/3;
+		double gapX = halfLength-fabs(xPrime);
+		double gapY = width[i]/2-fabs(yPrime);
+		double gapZ = top-zPrime;
+		double nx = 0, ny = 0, nz = 0;
+		if(gapZ <= gapX && gapZ <= gapY)
+			nz = 1;
+		else if(gapX <= gapY)
+			nx = xPrime < 0 ? -1 : 1;
+		else
+			ny = yPrime < 0 ? -1 : 1;
+		// turn back from the car frame by the heading
+		double c = cosNegTheta[i], s = -sinNegTheta[i];
+		return Vect3(nx*c - ny*s, nx*s + ny*c, nz);
+	}
+
+	// axis aligned bounding box around rotated car i
+	Box box(size_t i) const
+	{
+		double c = fabs(cos(angle[i]));
+		double s = fabs(sin(angle[i]));
+		double halfX = c*length[i]/2 + s*width[i]/2;
+		double halfY = s*length[i]/2 + c*width[i]/2;
+		Box b;
+		b.x_min = x[i] - halfX;
+		b.x_max = x[i] + halfX;
+		b.y_min = y[i] - halfY;
+		b.y_max = y[i] + halfY;
+		b.z_min = z[i];
+		b.z_max = z[i] + height[i];
+		return b;
+	}
+
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+#include "traffic_view.h"
+#include "static_scene.h"
+
+// which cars a sensor can see. A car is visible if the line of sight to any of its corners is
+// clear of the other cars and of the static scene. The sight lines of all cars are sampled
+// into one batch and every car is tested against it once, the same point tests the lidar
+// ray casts use. Static objects are boxes so their hierarchy answers exactly per sight line.
+struct VisibilityQuery
+{
+
+	// spacing of the samples along a sight line, same as the lidar ray step
+	double resolution;
+	// corners are pulled in this far so they sit on the car and not in the air next to it
+	double inset;
+
+	// scratch space
+	PointBatch samples;
+	std::vector<int> sampleLine;
+	std::vector<uint8_t> hits;
+	std::vector<Box> staticBoxes;
+
+	VisibilityQuery()
+		: resolution(0.2), inset(0.1)
+	{}
+
+	// visible[i] is 1 if car i can be seen from origin, statics are offset along the road like for the lidar
+	void run(const TrafficView& cars, const StaticScene* statics, double offset, const Vect3& origin, std::vector<uint8_t>& visible)
+	{
+		size_t n = cars.size();
+		// four footprint corners per car at a third of its height
+		std::vector<Vect3> targets;
+		for(size_t i = 0; i < n; i++)
+		{
+			double c = cars.cosNegTheta[i], s = -cars.sinNegTheta[i];
+			double halfLength = cars.length[i]/2-inset, halfWidth = cars.width[i]/2-inset;
+			for(int corner = 0; corner < 4; corner++)
+			{
+				double along = (corner & 1) ? halfLength : -halfLength;
+				double across = (corner & 2) ? halfWidth : -halfWidth;
+				targets.push_back(Vect3(cars.x[i] + along*c - across*s, cars.y[i] + along*s + across*c, cars.z[i] + cars.height[i]/3));
+			}
+		}
+
+		// a sight line is blocked by a static object it crosses or by another car containing one of its samples
+		std::vector<uint8_t> blocked(targets.size(), 0);
+		samples.clear();
+		sampleLine.clear();
+		for(size_t line = 0; line < targets.size(); line++)
+		{
+			const Vect3& target = targets[line];
+			if(statics)
+			{
+				statics->crossing(origin, target, offset, staticBoxes);
+				if(!staticBoxes.empty())
+				{
+					blocked[line] = 1;
+					continue;
+				}
+			}
+			double dx = target.x-origin.x, dy = target.y-origin.y, dz = target.z-origin.z;
+			int steps = sqrt(dx*dx + dy*dy + dz*dz)/resolution;
+			for(int k = 1; k < steps; k++)
+			{
+				double t = (double)k/steps;
+				samples.push_back(Vect3(origin.x + dx*t, origin.y + dy*t, origin.z + dz*t));
+				sampleLine.push_back(line);
+			}
+		}
+
+		double from[3] = {origin.x, origin.y, origin.z};
+		for(size_t i = 0; i < n; i++)
+		{
+			// skip cars no sight line gets near
+			Box box = cars.box(i);
+			bool near = false;
+			for(size_t line = 0; line < targets.size() && !near; line++)
+			{
+				double to[3] = {targets[line].x, targets[line].y, targets[line].z};
+				near = (line/4 != i) && !blocked[line] && StaticScene::segmentCrosses(box, from, to);
+			}
+			if(!near)
+				continue;
+			cars.checkCollisions(i, samples, hits);
+			for(size_t k = 0; k < samples.size(); k++)
+			{
+				// a car doesn't hide itself
+				if(hits[k] && (size_t)sampleLine[k]/4 != i)
+					blocked[sampleLine[k]] = 1;
+			}
+		}
+
+		visible.assign(n, 0);
+		for(size_t line = 0; line < targets.size(); line++)
+			visible[line/4] |= !blocked[line];
+	}
+
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+#include "event_queue.h"
+#include <cmath>
+#include <functional>
+
+// discrete event kernel: sensor firings, render ticks and anything else are events on one
+// timeline and the simulation jumps straight from one event to the next, so nothing runs
+// between events and every source can have its own rate
+struct Simulator
+{
+
+	typedef std::function<void(long long)> Callback;
+
+	EventQueue<Callback> events;
+	// time of the event being run
+	long long now_us;
+
+	Simulator()
+		: now_us(0)
+	{}
+
+	void schedule(long long time_us, const Callback& callback)
+	{
+		events.push(time_us, callback);
+	}
+
+	// run callback rate_hz times a second from start_us. Tick k fires at start_us + k*1e6/rate_hz
+	// in whole microseconds, worked out from k so the rounding doesn't add up over the ticks
+	void schedulePeriodic(long long start_us, double rate_hz, const Callback& callback)
+	{
+		if(rate_hz <= 0)
+			return;
+		scheduleTick(start_us, rate_hz, 0, callback);
+	}
+
+	void scheduleTick(long long start_us, double rate_hz, long long tick, const Callback& callback)
+	{
+		long long time_us = start_us + (long long)std::floor(tick*1e6/rate_hz);
+		schedule(time_us, [this, start_us, rate_hz, tick, callback](long long time_us)
+		{
+			callback(time_us);
+			scheduleTick(start_us, rate_hz, tick + 1, callback);
+		});
+	}
+
+	// run all events before end_us in time order, an event at end_us doesn't run
+	void runUntil(long long end_us)
+	{
+		while(!events.empty() && events.top().time_us < end_us)
+		{
+			EventQueue<Callback>::Event event = events.pop();
+			now_us = event.time_us;
+			event.payload(now_us);
+		}
+		now_us = end_us;
+	}
+
+};
+
+#endif
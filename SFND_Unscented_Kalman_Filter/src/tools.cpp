@@ -17,8 +17,8 @@ double Tools::noise(double stddev, long long seedNum)
 	return dist();
 }
 
-// sense where a car is located using lidar measurement
-lmarker Tools::lidarSense(Car& car, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize)
+// sense where a car is located using lidar measurement, the UKF is updated with it later
+MeasurementPackage Tools::lidarMeasure(const Car& car, long long timestamp, bool visualize)
 {
 	MeasurementPackage meas_package;
 	meas_package.sensor_type_ = MeasurementPackage::LASER;
@@ -26,18 +26,16 @@ lmarker Tools::lidarSense(Car& car, pcl::visualization::PCLVisualizer::Ptr& view
 
 	lmarker marker = lmarker(car.position.x + noise(0.15,timestamp), car.position.y + noise(0.15,timestamp+1));
 	if(visualize)
-		viewer->addSphere(pcl::PointXYZ(marker.x,marker.y,3.0),0.5, 1, 0, 0,car.name+"_lmarker");
+		markers.lidarMarkers.addSphere(marker.x, marker.y, 3.0, Color(1, 0, 0));
 
     meas_package.raw_measurements_ << marker.x, marker.y;
     meas_package.timestamp_ = timestamp;
 
-    car.ukf.ProcessMeasurement(meas_package);
-
-    return marker;
+    return meas_package;
 }
 
-// sense where a car is located using radar measurement
-rmarker Tools::radarSense(Car& car, Car ego, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize)
+// sense where a car is located using radar measurement, the UKF is updated with it later
+MeasurementPackage Tools::radarMeasure(const Car& car, const Car& ego, long long timestamp, bool visualize)
 {
 	double rho = sqrt((car.position.x-ego.position.x)*(car.position.x-ego.position.x)+(car.position.y-ego.position.y)*(car.position.y-ego.position.y));
 	double phi = atan2(car.position.y-ego.position.y,car.position.x-ego.position.x);
@@ -46,8 +44,8 @@ rmarker Tools::radarSense(Car& car, Car ego, pcl::visualization::PCLVisualizer::
 	rmarker marker = rmarker(rho+noise(0.3,timestamp+2), phi+noise(0.03,timestamp+3), rho_dot+noise(0.3,timestamp+4));
 	if(visualize)
 	{
-		viewer->addLine(pcl::PointXYZ(ego.position.x, ego.position.y, 3.0), pcl::PointXYZ(ego.position.x+marker.rho*cos(marker.phi), ego.position.y+marker.rho*sin(marker.phi), 3.0), 1, 0, 1, car.name+"_rho");
-		viewer->addArrow(pcl::PointXYZ(ego.position.x+marker.rho*cos(marker.phi), ego.position.y+marker.rho*sin(marker.phi), 3.0), pcl::PointXYZ(ego.position.x+marker.rho*cos(marker.phi)+marker.rho_dot*cos(marker.phi), ego.position.y+marker.rho*sin(marker.phi)+marker.rho_dot*sin(marker.phi), 3.0), 1, 0, 1, car.name+"_rho_dot");
+		markers.radarRays.addLine(ego.position.x, ego.position.y, 3.0, ego.position.x+marker.rho*cos(marker.phi), ego.position.y+marker.rho*sin(marker.phi), 3.0, Color(1, 0, 1));
+		markers.radarRates.addArrow(ego.position.x+marker.rho*cos(marker.phi), ego.position.y+marker.rho*sin(marker.phi), 3.0, marker.rho_dot*cos(marker.phi), marker.rho_dot*sin(marker.phi), 0, Color(1, 0, 1));
 	}
 	
 	MeasurementPackage meas_package;
@@ -56,28 +54,28 @@ rmarker Tools::radarSense(Car& car, Car ego, pcl::visualization::PCLVisualizer::
     meas_package.raw_measurements_ << marker.rho, marker.phi, marker.rho_dot;
     meas_package.timestamp_ = timestamp;
 
-    car.ukf.ProcessMeasurement(meas_package);
-
-    return marker;
+    return meas_package;
 }
 
 // Show UKF tracking and also allow showing predicted future path
 // double time:: time ahead in the future to predict
 // int steps:: how many steps to show between present and time and future time
-void Tools::ukfResults(Car car, pcl::visualization::PCLVisualizer::Ptr& viewer, double time, int steps)
+void Tools::ukfResults(const TrackPool& tracks, size_t track, pcl::visualization::PCLVisualizer::Ptr& viewer, double time, int steps)
 {
-	UKF ukf = car.ukf;
-	viewer->addSphere(pcl::PointXYZ(ukf.x_[0],ukf.x_[1],3.5), 0.5, 0, 1, 0,car.name+"_ukf");
-	viewer->addArrow(pcl::PointXYZ(ukf.x_[0], ukf.x_[1],3.5), pcl::PointXYZ(ukf.x_[0]+ukf.x_[2]*cos(ukf.x_[3]),ukf.x_[1]+ukf.x_[2]*sin(ukf.x_[3]),3.5), 0, 1, 0, car.name+"_ukf_vel");
+	// predict on a copy, the track itself only moves with its measurements
+	UKF::State state = tracks[track];
+	markers.estimates.addSphere(state.x_[0], state.x_[1], 3.5, Color(0, 1, 0));
+	markers.velocities.addArrow(state.x_[0], state.x_[1], 3.5, state.x_[2]*cos(state.x_[3]), state.x_[2]*sin(state.x_[3]), 0, Color(0, 1, 0));
+	ellipses.add(state);
 	if(time > 0)
 	{
+		UKF ukf(state, tracks.config(track));
 		double dt = time/steps;
 		double ct = dt;
 		while(ct <= time)
 		{
 			ukf.Prediction(dt);
-			viewer->addSphere(pcl::PointXYZ(ukf.x_[0],ukf.x_[1],3.5), 0.5, 0, 1, 0,car.name+"_ukf"+std::to_string(ct));
-			viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_OPACITY, 1.0-0.8*(ct/time), car.name+"_ukf"+std::to_string(ct));
+			markers.estimates.addSphere(state.x_[0], state.x_[1], 3.5, Color(0, 1, 0), 1.0-0.8*(ct/time));
 			//viewer->addArrow(pcl::PointXYZ(ukf.x_[0], ukf.x_[1],3.5), pcl::PointXYZ(ukf.x_[0]+ukf.x_[2]*cos(ukf.x_[3]),ukf.x_[1]+ukf.x_[2]*sin(ukf.x_[3]),3.5), 0, 1, 0, car.name+"_ukf_vel"+std::to_string(ct));
 			//viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_OPACITY, 1.0-0.8*(ct/time), car.name+"_ukf_vel"+std::to_string(ct));
 			ct += dt;
@@ -3,6 +3,9 @@
 #include <vector>
 #include "Eigen/Dense"
 #include "render/render.h"
+#include "render/marker_batch.h"
+#include "render/covariance_ellipses.h"
+#include "track_pool.h"
 #include <pcl/io/pcd_io.h>
 
 using Eigen::MatrixXd;
@@ -42,11 +45,17 @@ class Tools {
 	// Members
 	std::vector<VectorXd> estimations;
 	std::vector<VectorXd> ground_truth;
+	// sensor and estimate markers, drawn together when flushed
+	MarkerBatches markers;
+	// position uncertainty of the tracks shown this frame
+	CovarianceEllipses ellipses;
 	
 	double noise(double stddev, long long seedNum);
-	lmarker lidarSense(Car& car, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize);
-	rmarker radarSense(Car& car, Car ego, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize);
-	void ukfResults(Car car, pcl::visualization::PCLVisualizer::Ptr& viewer, double time, int steps);
+	// measurements for updating the UKFs later, sensor markers are added here
+	MeasurementPackage lidarMeasure(const Car& car, long long timestamp, bool visualize);
+	MeasurementPackage radarMeasure(const Car& car, const Car& ego, long long timestamp, bool visualize);
+	// estimate of a track and its prediction time ahead in steps
+	void ukfResults(const TrackPool& tracks, size_t track, pcl::visualization::PCLVisualizer::Ptr& viewer, double time, int steps);
 	/**
 	* A helper method to calculate RMSE.
 	*/
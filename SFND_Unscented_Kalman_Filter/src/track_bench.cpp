@@ -0,0 +1,107 @@
+// Measures how UKF updates scale from 1 to N threads with the track states packed next to each
+// other in a vector and with every state in its own cache lines in a TrackPool.
+// Threads take every N-th track, so neighboring filters are updated by different threads.
+// usage: track_bench [max threads] [tracks] [updates per track]
+
+#include "ukf.h"
+#include "track_pool.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <thread>
+
+// straight tracks in parallel lanes, lidar and radar measurements taking turns at 30 Hz each
+std::vector<std::vector<MeasurementPackage>> makeMeasurements(int tracks, int updates)
+{
+	std::vector<std::vector<MeasurementPackage>> measurements(tracks);
+	std::mt19937 gen(1);
+	std::normal_distribution<double> noise(0, 1);
+	for(int track = 0; track < tracks; track++)
+	{
+		double y = -20 + 40.0*track/tracks;
+		double speed = 5 + track%10;
+		for(int k = 0; k < updates; k++)
+		{
+			long long timestamp = k*16667LL;
+			double x = 10 + speed*timestamp/1e6;
+			MeasurementPackage meas_package;
+			meas_package.timestamp_ = timestamp;
+			if(k%2 == 0)
+			{
+				meas_package.sensor_type_ = MeasurementPackage::LASER;
+				meas_package.raw_measurements_ = Eigen::VectorXd(2);
+				meas_package.raw_measurements_ << x + 0.15*noise(gen), y + 0.15*noise(gen);
+			}
+			else
+			{
+				double rho = sqrt(x*x + y*y);
+				meas_package.sensor_type_ = MeasurementPackage::RADAR;
+				meas_package.raw_measurements_ = Eigen::VectorXd(3);
+				meas_package.raw_measurements_ << rho + 0.3*noise(gen), atan2(y, x) + 0.03*noise(gen), speed*x/rho + 0.3*noise(gen);
+			}
+			measurements[track].push_back(meas_package);
+		}
+	}
+	return measurements;
+}
+
+// updates per second of all threads together, update(track, measurement) runs one update
+template <typename Update>
+double run(Update update, int tracks, int threads, const std::vector<std::vector<MeasurementPackage>>& measurements)
+{
+	int updates = measurements[0].size();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for(int t = 0; t < threads; t++)
+	{
+		workers.push_back(std::thread([&, t]()
+		{
+			Realtime::pin(t % std::max(1u, std::thread::hardware_concurrency()));
+			for(int k = 0; k < updates; k++)
+				for(int track = t; track < tracks; track += threads)
+					update(track, measurements[track][k]);
+		}));
+	}
+	for(std::thread& worker : workers)
+		worker.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return (double)tracks*updates/seconds;
+}
+
+int main(int argc, char** argv)
+{
+	// at least two threads by default, sharing only shows with more than one writer
+	int maxThreads = (argc > 1) ? atoi(argv[1]) : std::max(2u, std::thread::hardware_concurrency());
+	int tracks = (argc > 2) ? atoi(argv[2]) : 64;
+	int updates = (argc > 3) ? atoi(argv[3]) : 2000;
+	std::vector<std::vector<MeasurementPackage>> measurements = makeMeasurements(tracks, updates);
+
+	std::cout << "track state is " << sizeof(UKF::State) << " bytes, " << TrackPool().slotSize << " in a pool slot" << std::endl;
+	std::cout << "threads  vector updates/s  speedup  pool updates/s  speedup" << std::endl;
+	double vectorBase = 0, poolBase = 0;
+	for(int threads = 1; threads <= maxThreads; threads++)
+	{
+		UKF::Config config;
+		std::vector<UKF::State> packed(tracks);
+		double vectorRate = run([&](int track, const MeasurementPackage& measurement)
+		{
+			UKF(packed[track], config).ProcessMeasurement(measurement);
+		}, tracks, threads, measurements);
+
+		TrackPool pool;
+		for(int track = 0; track < tracks; track++)
+			pool.add(config);
+		double poolRate = run([&](int track, const MeasurementPackage& measurement)
+		{
+			pool.update(track, measurement);
+		}, tracks, threads, measurements);
+
+		if(threads == 1)
+		{
+			vectorBase = vectorRate;
+			poolBase = poolRate;
+		}
+		printf("%7d  %16.0f  %7.2f  %14.0f  %7.2f\n", threads, vectorRate, vectorRate/vectorBase, poolRate, poolRate/poolBase);
+	}
+}
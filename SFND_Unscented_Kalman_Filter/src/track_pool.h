@@ -0,0 +1,119 @@
+#ifndef TRACK_POOL_H
+#define TRACK_POOL_H
+#include "ukf.h"
+#include "realtime.h"
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// owns the filters of all tracks, cars and everything else refer to a track by its index.
+// What an update writes, the track's UKF::State, is kept in one block of memory with a slot
+// per track that starts on a cache line and covers whole lines, so threads updating different
+// tracks never write to the same line and an update touches only the lines of its own track.
+// The configurations are only read and kept apart in their own array, the scratch of an
+// update lives in the UKF made for it on the updating thread.
+struct TrackPool
+{
+
+	static const size_t lineSize = 64;
+	// bytes per track, sizeof(UKF::State) rounded up to whole cache lines
+	size_t slotSize;
+	size_t count;
+	// what malloc returned and the first line aligned slot in it
+	void* memory;
+	char* slots;
+	bool locked;
+	// noise and thresholds of every track
+	std::vector<UKF::Config> configs;
+
+	TrackPool()
+		: slotSize((sizeof(UKF::State)+lineSize-1)/lineSize*lineSize), count(0), memory(nullptr), slots(nullptr), locked(false)
+	{}
+
+	~TrackPool()
+	{
+		clear();
+	}
+
+	TrackPool(const TrackPool&) = delete;
+	TrackPool& operator=(const TrackPool&) = delete;
+
+	size_t size() const
+	{
+		return count;
+	}
+
+	size_t bytes() const
+	{
+		return count*slotSize;
+	}
+
+	UKF::State& operator[](size_t i)
+	{
+		return *reinterpret_cast<UKF::State*>(slots + i*slotSize);
+	}
+
+	const UKF::State& operator[](size_t i) const
+	{
+		return *reinterpret_cast<const UKF::State*>(slots + i*slotSize);
+	}
+
+	const UKF::Config& config(size_t i) const
+	{
+		return configs[i];
+	}
+
+	// run a measurement through track i
+	void update(size_t i, const MeasurementPackage& measurement)
+	{
+		UKF((*this)[i], configs[i]).ProcessMeasurement(measurement);
+	}
+
+	// add a track that is initialized by its first measurement and return its index. Tracks
+	// are added while setting up, every add moves the states to a new block and unlocks it
+	size_t add(const UKF::Config& config = UKF::Config())
+	{
+		size_t n = count+1;
+		void* grown = std::malloc(n*slotSize + lineSize);
+		if(!grown)
+			throw std::bad_alloc();
+		char* grownSlots = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(grown) + lineSize-1) & ~(uintptr_t)(lineSize-1));
+		for(size_t i = 0; i < count; i++)
+			new (grownSlots + i*slotSize) UKF::State((*this)[i]);
+		new (grownSlots + count*slotSize) UKF::State();
+		std::vector<UKF::Config> grownConfigs = configs;
+		grownConfigs.push_back(config);
+		clear();
+		memory = grown;
+		slots = grownSlots;
+		count = n;
+		configs.swap(grownConfigs);
+		return count-1;
+	}
+
+	void clear()
+	{
+		if(locked)
+			Realtime::unlock(slots, bytes());
+		locked = false;
+		for(size_t i = 0; i < count; i++)
+			(*this)[i].~State();
+		std::free(memory);
+		memory = nullptr;
+		slots = nullptr;
+		count = 0;
+		configs.clear();
+	}
+
+	// keep the states in RAM so updates never page fault
+	bool lock()
+	{
+		if(!locked && count > 0)
+			locked = Realtime::lock(slots, bytes());
+		return locked;
+	}
+
+};
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef TRACK_SCHEDULER_H
+#define TRACK_SCHEDULER_H
+#include "track_pool.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+// decides which tracks a sensor tick updates so the tick stays within a time budget.
+// Every update is timed and the smoothed cost per track predicts the next one. Tracks that
+// must not wait, because they are new, near the ego car, uncertain or have waited too often,
+// are always updated. The rest are updated in order of priority while the budget lasts and
+// skip the measurement otherwise, their filters coast until the next tick that has room.
+// Priority grows with uncertainty, yaw rate and waiting and falls with distance, so far,
+// steady, well known tracks are the first to be decimated.
+struct TrackScheduler
+{
+
+	// microseconds a tick may spend on updates
+	double budget;
+	// tracks closer than this in meters are always updated
+	double nearDistance;
+	// tracks whose position variance px + py is above this in m^2 are always updated
+	double maxUncertainty;
+	// a track is updated at least every maxDeferrals+1 ticks
+	int maxDeferrals;
+	// weight of the newest measurement in the smoothed cost
+	double smoothing;
+
+	// smoothed microseconds per update, 0 until measured
+	std::vector<double> cost;
+	// ticks each track has skipped in a row
+	std::vector<int> deferrals;
+	// the plan of the last tick, 1 if the track is updated
+	std::vector<uint8_t> run;
+	// tracks skipped by the last tick and all ticks so far
+	int deferred;
+	long long totalDeferred;
+
+	std::vector<double> score;
+	std::vector<size_t> optional;
+
+	TrackScheduler(double setBudget = 1000, double setNearDistance = 20, double setMaxUncertainty = 1, int setMaxDeferrals = 3)
+		: budget(setBudget), nearDistance(setNearDistance), maxUncertainty(setMaxUncertainty), maxDeferrals(setMaxDeferrals),
+		  smoothing(0.2), deferred(0), totalDeferred(0)
+	{}
+
+	// plan a tick over the tracks flagged in tracked, judged by their estimates since the truth is unknown to the tracker
+	const std::vector<uint8_t>& plan(const TrackPool& tracks, const std::vector<bool>& tracked)
+	{
+		size_t n = tracks.size();
+		cost.resize(n, 0);
+		deferrals.resize(n, 0);
+		run.assign(n, 0);
+		score.assign(n, 0);
+		optional.clear();
+
+		double spent = 0;
+		for(size_t i = 0; i < n; i++)
+		{
+			if(!tracked[i])
+				continue;
+			const UKF::State& track = tracks[i];
+			if(!track.IsInitialized())
+			{
+				run[i] = 1;
+				continue;
+			}
+			const UKF::StateMatrix& P = track.P_;
+			double distance = sqrt(track.x_[0]*track.x_[0] + track.x_[1]*track.x_[1]);
+			double uncertainty = P(0, 0) + P(1, 1);
+			if(distance < nearDistance || uncertainty > maxUncertainty || deferrals[i] >= maxDeferrals)
+			{
+				run[i] = 1;
+				spent += cost[i];
+				continue;
+			}
+			score[i] = (uncertainty + fabs(track.x_[4]))*(1 + deferrals[i])/distance;
+			optional.push_back(i);
+		}
+
+		std::sort(optional.begin(), optional.end(), [this](size_t a, size_t b) { return score[a] > score[b]; });
+		for(size_t i : optional)
+		{
+			if(spent + cost[i] > budget)
+				continue;
+			run[i] = 1;
+			spent += cost[i];
+		}
+
+		deferred = 0;
+		for(size_t i = 0; i < n; i++)
+		{
+			if(!tracked[i])
+				continue;
+			if(run[i])
+				deferrals[i] = 0;
+			else
+			{
+				deferrals[i]++;
+				deferred++;
+			}
+		}
+		totalDeferred += deferred;
+		return run;
+	}
+
+	// run and time one planned update, may run on several threads at once for different
+	// tracks so the costs are sized by whoever plans the tick before the updates start
+	template <typename Update>
+	void measure(size_t i, Update update)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		update();
+		double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		assert(i < cost.size());
+		cost[i] = (cost[i] > 0) ? cost[i] + smoothing*(us - cost[i]) : us;
+	}
+
+};
+
+#endif
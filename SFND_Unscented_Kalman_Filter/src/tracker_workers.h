@@ -0,0 +1,105 @@
+#ifndef TRACKER_WORKERS_H
+#define TRACKER_WORKERS_H
+#include "realtime.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// threads that stay alive between sensor ticks and run the tracks' filter updates.
+// Each worker is placed and prioritized once when it starts, so a tick only hands out
+// track indices. Workers take indices from a shared counter until none are left and the
+// tick returns when all of them are done.
+struct TrackerWorkers
+{
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	std::function<void(size_t)> job;
+	size_t count;
+	std::atomic<size_t> next;
+	// workers still working on the current tick
+	int busy;
+	// ticks handed out so far, a worker waits for the next one
+	long long tick;
+	bool stopping;
+
+	TrackerWorkers()
+		: count(0), next(0), busy(0), tick(0), stopping(false)
+	{}
+
+	~TrackerWorkers()
+	{
+		stop();
+	}
+
+	size_t size() const
+	{
+		return threads.size();
+	}
+
+	void start(int workers, const RealtimeConfig& config)
+	{
+		stop();
+		stopping = false;
+		for(int i = 0; i < workers; i++)
+			threads.push_back(std::thread([this, config, i]() { work(config, i); }));
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for(std::thread& thread : threads)
+			thread.join();
+		threads.clear();
+	}
+
+	// call update(i) for every i below setCount on the workers, inline without any
+	void run(size_t setCount, const std::function<void(size_t)>& update)
+	{
+		if(threads.empty())
+		{
+			for(size_t i = 0; i < setCount; i++)
+				update(i);
+			return;
+		}
+		std::unique_lock<std::mutex> lock(mutex);
+		job = update;
+		count = setCount;
+		next = 0;
+		busy = threads.size();
+		tick++;
+		wake.notify_all();
+		done.wait(lock, [this]() { return busy == 0; });
+	}
+
+	void work(const RealtimeConfig& config, int worker)
+	{
+		Realtime::apply(config, worker, "tracker worker");
+		long long seen = 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		while(true)
+		{
+			wake.wait(lock, [&]() { return stopping || tick != seen; });
+			if(stopping)
+				return;
+			seen = tick;
+			lock.unlock();
+			for(size_t i = next++; i < count; i = next++)
+				job(i);
+			lock.lock();
+			if(--busy == 0)
+				done.notify_one();
+		}
+	}
+
+};
+
+#endif
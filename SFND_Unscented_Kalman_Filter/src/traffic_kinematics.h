@@ -0,0 +1,185 @@
+#ifndef TRAFFIC_KINEMATICS_H
+#define TRAFFIC_KINEMATICS_H
+#include "render/render.h"
+#include "event_queue.h"
+#include <cmath>
+#include <algorithm>
+
+// integrates the kinematics of all cars at once. State is kept as one flat array per
+// quantity so the integration loops are branch free over contiguous memory. With -O3 and
+// -fno-math-errno, as the project build sets them, the compiler runs the position update and
+// the quaternion loop in SIMD batches, the sin/cos calls in between stay scalar. Each step
+// evaluates sin/cos once per car and builds the orientation quaternion straight from the half angle.
+// Accuation instructions of all cars wait in one time ordered queue and take effect
+// exactly at their timestamps, whatever the frame rate.
+struct TrafficKinematics
+{
+
+	// an accuation instruction waiting to be applied to a car
+	struct Accuation
+	{
+		size_t car;
+		int index;
+		double acceleration;
+		double steering;
+
+		Accuation(size_t setCar, int setIndex, double setAcceleration, double setSteering)
+			: car(setCar), index(setIndex), acceleration(setAcceleration), steering(setSteering)
+		{}
+	};
+
+	std::vector<double> x, y;
+	std::vector<double> angle, velocity, acceleration, steering, Lf;
+	// sin/cos of the current angle, carried over to the next step's position update
+	std::vector<double> sinTheta, cosTheta;
+	// orientation quaternion around z, w = cos(angle/2) and z = sin(angle/2)
+	std::vector<double> qw, qz;
+	// time each car has been integrated up to, cars run ahead of the rest while their instructions fire
+	std::vector<long long> clock_us;
+	std::vector<int> accuateIndex;
+	std::vector<double> stepDt;
+	EventQueue<Accuation> instructions;
+
+	size_t size() const
+	{
+		return x.size();
+	}
+
+	// take over the cars' state at time_us and queue their remaining instructions
+	void load(const std::vector<Car>& cars, long long time_us = 0)
+	{
+		size_t n = cars.size();
+		x.resize(n); y.resize(n);
+		angle.resize(n); velocity.resize(n); acceleration.resize(n); steering.resize(n); Lf.resize(n);
+		sinTheta.resize(n); cosTheta.resize(n); qw.resize(n); qz.resize(n);
+		clock_us.assign(n, time_us);
+		accuateIndex.resize(n);
+		stepDt.resize(n);
+		instructions.clear();
+		for(size_t i = 0; i < n; i++)
+		{
+			const Car& car = cars[i];
+			x[i] = car.position.x;
+			y[i] = car.position.y;
+			angle[i] = car.angle;
+			velocity[i] = car.velocity;
+			acceleration[i] = car.acceleration;
+			steering[i] = car.steering;
+			Lf[i] = car.Lf;
+			sinTheta[i] = sin(angle[i]);
+			cosTheta[i] = cos(angle[i]);
+			accuateIndex[i] = car.accuateIndex;
+			for(int j = car.accuateIndex+1; j < (int)car.instructions.size(); j++)
+			{
+				const accuation& a = car.instructions[j];
+				instructions.push(std::max(a.time_us, time_us), Accuation(i, j, a.acceleration, a.steering));
+			}
+		}
+		updateQuaternions();
+	}
+
+	// move every car to time_us, applying each instruction at its own timestamp on the way
+	void advanceTo(long long time_us)
+	{
+		while(!instructions.empty() && instructions.top().time_us <= time_us)
+		{
+			EventQueue<Accuation>::Event event = instructions.pop();
+			const Accuation& a = event.payload;
+			integrate(a.car, (event.time_us - clock_us[a.car])/1e6);
+			clock_us[a.car] = event.time_us;
+			acceleration[a.car] = a.acceleration;
+			steering[a.car] = a.steering;
+			accuateIndex[a.car] = a.index;
+		}
+
+		// bring every car up to time_us in one batch
+		for(size_t i = 0; i < size(); i++)
+		{
+			stepDt[i] = (time_us - clock_us[i])/1e6;
+			clock_us[i] = time_us;
+		}
+		step(stepDt);
+	}
+
+	// same model as Car::advance for a single car, used between instructions
+	void integrate(size_t i, double dt)
+	{
+		x[i] += velocity[i] * cosTheta[i] * dt;
+		y[i] += velocity[i] * sinTheta[i] * dt;
+		angle[i] += velocity[i]*steering[i]*dt/Lf[i];
+		velocity[i] += acceleration[i]*dt;
+		sinTheta[i] = sin(angle[i]);
+		cosTheta[i] = cos(angle[i]);
+	}
+
+	// same model as Car::advance for every car, each with its own time step
+	void step(const std::vector<double>& carDt)
+	{
+		const size_t n = size();
+		integrateBatch(n, carDt.data(), x.data(), y.data(), angle.data(), velocity.data(), acceleration.data(), steering.data(), Lf.data(), sinTheta.data(), cosTheta.data());
+		double* s = sinTheta.data();
+		double* c = cosTheta.data();
+		const double* a = angle.data();
+		for(size_t i = 0; i < n; i++)
+		{
+			s[i] = sin(a[i]);
+			c[i] = cos(a[i]);
+		}
+		updateQuaternions();
+	}
+
+	// the position, angle and velocity update of step. The arrays are passed as restrict
+	// parameters, the compiler can't tell that the vectors don't overlap and would otherwise
+	// need more runtime overlap checks than it is willing to emit
+	static void integrateBatch(size_t n, const double* __restrict dt, double* __restrict px, double* __restrict py, double* __restrict a, double* __restrict v,
+		const double* __restrict acc, const double* __restrict steer, const double* __restrict lf, const double* __restrict s, const double* __restrict c)
+	{
+		for(size_t i = 0; i < n; i++)
+		{
+			px[i] += v[i] * c[i] * dt[i];
+			py[i] += v[i] * s[i] * dt[i];
+			a[i] += v[i]*steer[i]*dt[i]/lf[i];
+			v[i] += acc[i]*dt[i];
+		}
+	}
+
+	// half angle from the full angle's cosine: w = sqrt((1+cos)/2) >= 0 and |z| = sqrt((1-cos)/2)
+	// with the sign of sin, which is the sign of sin(angle/2) when cos(angle/2) >= 0. q and -q are
+	// the same rotation so the sign choice doesn't matter, and without a division there is no
+	// special case at angle pi to keep the loop from vectorizing
+	void updateQuaternions()
+	{
+		const size_t n = size();
+		const double* s = sinTheta.data();
+		const double* c = cosTheta.data();
+		double* w = qw.data();
+		double* z = qz.data();
+		for(size_t i = 0; i < n; i++)
+		{
+			w[i] = std::sqrt(std::max(0.0, (1 + c[i])/2));
+			z[i] = std::copysign(std::sqrt(std::max(0.0, (1 - c[i])/2)), s[i]);
+		}
+	}
+
+	// write the integrated state back into the cars for rendering and sensing
+	void store(std::vector<Car>& cars) const
+	{
+		for(size_t i = 0; i < cars.size(); i++)
+		{
+			Car& car = cars[i];
+			car.position.x = x[i];
+			car.position.y = y[i];
+			car.angle = angle[i];
+			car.velocity = velocity[i];
+			car.acceleration = acceleration[i];
+			car.steering = steering[i];
+			car.orientation = Eigen::Quaternionf(qw[i], 0, 0, qz[i]);
+			car.sinNegTheta = -sinTheta[i];
+			car.cosNegTheta = cosTheta[i];
+			car.accuateIndex = accuateIndex[i];
+		}
+	}
+
+};
+
+#endif
@@ -1,30 +1,53 @@
 #include "ukf.h"
 #include "Eigen/Dense"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 using Eigen::MatrixXd;
 using Eigen::VectorXd;
 
 /**
- * Initializes Unscented Kalman filter
+ * Initializes the state of a track, set by its first measurement
  */
-UKF::UKF()
+UKF::State::State()
 {
   // Initialize UKF on first process measurement call
   is_initialized_ = false;
 
+  // initial state vector
+  x_.setZero();
+
+  // initial covariance matrix
+  P_.setZero();
+
+  time_us_ = 0;
+
+  // run the UKF until the hybrid mode switches
+  linear_ = false;
+
+  // constant velocity state and covariance
+  x_cv_.setZero();
+  P_cv_.setZero();
+
+  nis_ = 0;
+  stable_updates_ = 0;
+  outliers_ = 0;
+  linear_yawd_var_ = 0;
+  linear_since_us_ = 0;
+}
+
+/**
+ * Initializes the noise and weights of Unscented Kalman filter
+ */
+UKF::Config::Config()
+{
   // if this is false, laser measurements will be ignored (except during init)
   use_laser_ = true;
 
   // if this is false, radar measurements will be ignored (except during init)
   use_radar_ = true;
 
-  // initial state vector
-  x_ = VectorXd(5);
-
-  // initial covariance matrix
-  P_ = MatrixXd(5, 5);
-
   // Process noise standard deviation longitudinal acceleration in m/s^2
   std_a_ = 1.5;
 
@@ -64,18 +87,6 @@ UKF::UKF()
   // Augmented state dimension
   n_aug_ = 7;
 
-  // Sigma point matrix without augmentation for noise
-  Xsig_ = MatrixXd(n_x_, 2 * n_x_ + 1);
-
-  // Augmented sigma point matrix
-  Xsig_aug_ = MatrixXd(n_aug_, 2 * n_aug_ + 1);
-
-  // predicted sigma points matrix
-  Xsig_pred_ = MatrixXd(n_x_, 2 * n_aug_ + 1);
-
-  // Weights of sigma points
-  weights_ = VectorXd(2 * n_aug_ + 1);
-
   // Sigma point spreading parameter
   lambda_ = 3 - n_x_;
 
@@ -85,68 +96,101 @@ UKF::UKF()
   // Measurement dimension lidar
   n_z_lidar_ = 2;
 
-  // mean predicted measurement vector radar
-  z_pred_r_ = VectorXd(n_z_radar_);
+  // initialize weights
+  double weight_0 = lambda_ / (lambda_ + n_aug_);
+  weights_(0) = weight_0;
 
-  // measurement covariance matrix S radar
-  S_r_ = MatrixXd(n_z_radar_, n_z_radar_);
+  for (int i = 1; i < (2 * n_aug_ + 1); ++i)
+  {
+    double weight = 0.5 / (n_aug_ + lambda_);
+    weights_(i) = weight;
+  }
 
-  // sigma point matrix in radar measurement dimension
-  Zsig_radar = MatrixXd(n_z_radar_, 2 * n_aug_ + 1);
+  // run the UKF only unless hybrid mode is set
+  use_hybrid_ = false;
 
-  // sigma point matrix in radar measurement dimension
-  Zsig_lidar = MatrixXd(n_z_lidar_, 2 * n_aug_ + 1);
+  // switch to the linear filter below 0.15 rad/s of yaw rate known to 0.3 rad/s after 10 stable updates
+  hybrid_yawd_ = 0.15;
+  hybrid_yawd_std_ = 0.3;
+  hybrid_stable_updates_ = 10;
 
-  // mean predicted measurement vector lidar
-  z_pred_l_ = VectorXd(n_z_lidar_);
+  nis_gate_lidar_ = 5.991;
+  nis_gate_radar_ = 7.815;
+}
 
-  // measurement covariance matrix S lidar
-  S_l_ = MatrixXd(n_z_lidar_, n_z_lidar_);
+/**
+ * Runs Unscented Kalman filter on a track, the scratch is filled by every update before it is read
+ */
+UKF::UKF(State &state, const Config &config)
+    : state_(state), config_(config)
+{
 }
 
 UKF::~UKF() {}
 
-void UKF::ProcessMeasurement(MeasurementPackage meas_package)
+void UKF::ProcessMeasurement(const MeasurementPackage &meas_package)
 {
   /**
    * Processes lidar and radar measurements
    * measurements.
    */
-  if (!is_initialized_)
+  if (!state_.is_initialized_)
   {
     InitializeUKF(meas_package);
     return;
   }
 
   // Calculate time since last measurement in seconds
-  double delta_t = (meas_package.timestamp_ - time_us_) / 1000000.0;
-  time_us_ = meas_package.timestamp_;
+  double delta_t = (meas_package.timestamp_ - state_.time_us_) / 1000000.0;
+  state_.time_us_ = meas_package.timestamp_;
 
-  // Prediction
-  Prediction(delta_t);
-
-  // Update
-  if (meas_package.sensor_type_ == MeasurementPackage::LASER)
+  if (state_.linear_)
   {
-    PredictLidarMeasurement();
-    UpdateLidar(meas_package);
+    // constant velocity filter, x_ and P_ follow it so they always hold the CTRV estimate
+    PredictLinear(delta_t);
+    if (meas_package.sensor_type_ == MeasurementPackage::LASER)
+    {
+      UpdateLidarLinear(meas_package);
+    }
+    else if (meas_package.sensor_type_ == MeasurementPackage::RADAR)
+    {
+      UpdateRadarLinear(meas_package);
+    }
+    LinearToCTRV();
   }
-  else if (meas_package.sensor_type_ == MeasurementPackage::RADAR)
+  else
+  {
+    // Prediction
+    Prediction(delta_t);
+
+    // Update
+    if (meas_package.sensor_type_ == MeasurementPackage::LASER)
+    {
+      PredictLidarMeasurement();
+      UpdateLidar(meas_package);
+    }
+    else if (meas_package.sensor_type_ == MeasurementPackage::RADAR)
+    {
+      PredictRadarMeasurement();
+      UpdateRadar(meas_package);
+    }
+  }
+
+  if (config_.use_hybrid_)
   {
-    PredictRadarMeasurement();
-    UpdateRadar(meas_package);
+    SelectModel(meas_package.sensor_type_);
   }
 }
 
-void UKF::InitializeUKF(MeasurementPackage meas_package)
+void UKF::InitializeUKF(const MeasurementPackage &meas_package)
 {
-  is_initialized_ = true;
+  state_.is_initialized_ = true;
 
   // set time of first measurement;
-  time_us_ = meas_package.timestamp_;
+  state_.time_us_ = meas_package.timestamp_;
 
   // initialize covariance matrix
-  P_ << 1, 0, 0, 0, 0,
+  state_.P_ << 1, 0, 0, 0, 0,
       0, 1, 0, 0, 0,
       0, 0, 1, 0, 0,
       0, 0, 0, 0.5, 0,
@@ -168,17 +212,7 @@ void UKF::InitializeUKF(MeasurementPackage meas_package)
     py = sin(phi) * rho;
   }
 
-  x_ << px, py, 0.0, 0.0, 0.0;
-
-  // initialize weights
-  double weight_0 = lambda_ / (lambda_ + n_aug_);
-  weights_(0) = weight_0;
-
-  for (int i = 1; i < (2 * n_aug_ + 1); ++i)
-  {
-    double weight = 0.5 / (n_aug_ + lambda_);
-    weights_(i) = weight;
-  }
+  state_.x_ << px, py, 0.0, 0.0, 0.0;
 }
 
 void UKF::Prediction(double delta_t)
@@ -188,6 +222,12 @@ void UKF::Prediction(double delta_t)
    * Modify the state vector, x_. Predict sigma points, the state, 
    * and the state covariance matrix.
    */
+  if (state_.linear_)
+  {
+    PredictLinear(delta_t);
+    LinearToCTRV();
+    return;
+  }
   GenerateAugmentedSigmaPoints();
   SigmaPointPrediction(delta_t);
   PredictMeanAndCovariance();
@@ -199,27 +239,27 @@ void UKF::GenerateAugmentedSigmaPoints()
   Xsig_aug_.fill(0.0);
 
   // create augmented mean vector
-  VectorXd x_aug = VectorXd(n_aug_);
+  Fixed<7, 1> x_aug;
   x_aug.fill(0.0);
-  x_aug.head(n_x_) = x_;
+  x_aug.head(config_.n_x_) = state_.x_;
 
   // create augmented covariance matrix
-  MatrixXd P_aug = MatrixXd(n_aug_, n_aug_);
+  Fixed<7, 7> P_aug;
   P_aug.fill(0.0);
-  P_aug.topLeftCorner(n_x_, n_x_) = P_;
-  P_aug(n_x_, n_x_) = std_a_ * std_a_;
-  P_aug(n_x_ + 1, n_x_ + 1) = std_yawdd_ * std_yawdd_;
+  P_aug.topLeftCorner(config_.n_x_, config_.n_x_) = state_.P_;
+  P_aug(config_.n_x_, config_.n_x_) = config_.std_a_ * config_.std_a_;
+  P_aug(config_.n_x_ + 1, config_.n_x_ + 1) = config_.std_yawdd_ * config_.std_yawdd_;
 
   // create square root matrix
-  MatrixXd L = P_aug.llt().matrixL();
+  Fixed<7, 7> L = P_aug.llt().matrixL();
 
   // create augmented sigma points
   Xsig_aug_.col(0) = x_aug;
 
-  for (int i = 0; i < n_aug_; ++i)
+  for (int i = 0; i < config_.n_aug_; ++i)
   {
-    Xsig_aug_.col(i + 1) = x_aug + sqrt(lambda_ + n_aug_) * L.col(i);
-    Xsig_aug_.col(i + 1 + n_aug_) = x_aug - sqrt(lambda_ + n_aug_) * L.col(i);
+    Xsig_aug_.col(i + 1) = x_aug + sqrt(config_.lambda_ + config_.n_aug_) * L.col(i);
+    Xsig_aug_.col(i + 1 + config_.n_aug_) = x_aug - sqrt(config_.lambda_ + config_.n_aug_) * L.col(i);
   }
 }
 
@@ -228,7 +268,7 @@ void UKF::SigmaPointPrediction(double delta_t)
   Xsig_pred_.fill(0.0);
 
   // predict sigma points
-  for (int i = 0; i < (2 * n_aug_ + 1); ++i)
+  for (int i = 0; i < (2 * config_.n_aug_ + 1); ++i)
   {
     double p_x = Xsig_aug_(0, i);
     double p_y = Xsig_aug_(1, i);
@@ -277,19 +317,19 @@ void UKF::SigmaPointPrediction(double delta_t)
 void UKF::PredictMeanAndCovariance()
 {
   // predicted state mean
-  x_.fill(0.0);
+  state_.x_.fill(0.0);
 
-  for (int i = 0; i < (2 * n_aug_ + 1); ++i)
+  for (int i = 0; i < (2 * config_.n_aug_ + 1); ++i)
   {
-    x_ = x_ + weights_(i) * Xsig_pred_.col(i);
+    state_.x_ = state_.x_ + config_.weights_(i) * Xsig_pred_.col(i);
   }
 
   // predicted state covariance matrix
-  P_.fill(0.0);
-  for (int i = 0; i < (2 * n_aug_ + 1); ++i)
+  state_.P_.fill(0.0);
+  for (int i = 0; i < (2 * config_.n_aug_ + 1); ++i)
   {
     // state difference
-    VectorXd x_diff = Xsig_pred_.col(i) - x_;
+    StateVector x_diff = Xsig_pred_.col(i) - state_.x_;
 
     // angle normalization
     while (x_diff(3) > M_PI)
@@ -301,7 +341,7 @@ void UKF::PredictMeanAndCovariance()
       x_diff(3) += 2. * M_PI;
     }
 
-    P_ = P_ + weights_(i) * x_diff * x_diff.transpose();
+    state_.P_ = state_.P_ + config_.weights_(i) * x_diff * x_diff.transpose();
   }
 }
 
@@ -310,7 +350,7 @@ void UKF::PredictRadarMeasurement()
 
   Zsig_radar.fill(0.0);
   // transform sigma points into measurement space
-  for (int i = 0; i < (2 * n_aug_ + 1); ++i)
+  for (int i = 0; i < (2 * config_.n_aug_ + 1); ++i)
   {
     // extract state vector values from sigma points
     double p_x = Xsig_pred_(0, i);
@@ -329,17 +369,17 @@ void UKF::PredictRadarMeasurement()
 
   // mean predicted measurement
   z_pred_r_.fill(0.0);
-  for (int i = 0; i < (2 * n_aug_ + 1); ++i)
+  for (int i = 0; i < (2 * config_.n_aug_ + 1); ++i)
   {
-    z_pred_r_ = z_pred_r_ + weights_(i) * Zsig_radar.col(i);
+    z_pred_r_ = z_pred_r_ + config_.weights_(i) * Zsig_radar.col(i);
   }
 
   // measurement covariance matrix S
   S_r_.fill(0.0);
-  for (int i = 0; i < 2 * n_aug_ + 1; ++i)
+  for (int i = 0; i < 2 * config_.n_aug_ + 1; ++i)
   {
     // residual
-    VectorXd z_diff = Zsig_radar.col(i) - z_pred_r_;
+    Fixed<3, 1> z_diff = Zsig_radar.col(i) - z_pred_r_;
 
     // angle normalization
     while (z_diff(1) > M_PI)
@@ -351,14 +391,14 @@ void UKF::PredictRadarMeasurement()
       z_diff(1) += 2. * M_PI;
     }
 
-    S_r_ = S_r_ + weights_(i) * z_diff * z_diff.transpose();
+    S_r_ = S_r_ + config_.weights_(i) * z_diff * z_diff.transpose();
   }
 
   // add measurement noise covariance matrix
-  MatrixXd R = MatrixXd(n_z_radar_, n_z_radar_);
-  R << std_radr_ * std_radr_, 0, 0,
-      0, std_radphi_ * std_radphi_, 0,
-      0, 0, std_radrd_ * std_radrd_;
+  Fixed<3, 3> R;
+  R << config_.std_radr_ * config_.std_radr_, 0, 0,
+      0, config_.std_radphi_ * config_.std_radphi_, 0,
+      0, 0, config_.std_radrd_ * config_.std_radrd_;
   S_r_ = S_r_ + R;
 }
 
@@ -367,7 +407,7 @@ void UKF::PredictLidarMeasurement()
 
   Zsig_lidar.fill(0.0);
   // transform sigma points into measurement space
-  for (int i = 0; i < (2 * n_aug_ + 1); ++i)
+  for (int i = 0; i < (2 * config_.n_aug_ + 1); ++i)
   {
     // extract state vector values from sigma points
     double p_x = Xsig_pred_(0, i);
@@ -380,29 +420,29 @@ void UKF::PredictLidarMeasurement()
 
   // mean predicted measurement
   z_pred_l_.fill(0.0);
-  for (int i = 0; i < (2 * n_aug_ + 1); ++i)
+  for (int i = 0; i < (2 * config_.n_aug_ + 1); ++i)
   {
-    z_pred_l_ = z_pred_l_ + weights_(i) * Zsig_lidar.col(i);
+    z_pred_l_ = z_pred_l_ + config_.weights_(i) * Zsig_lidar.col(i);
   }
 
   // measurement covariance matrix S
   S_l_.fill(0.0);
-  for (int i = 0; i < (2 * n_aug_ + 1); ++i)
+  for (int i = 0; i < (2 * config_.n_aug_ + 1); ++i)
   {
     // residual
-    VectorXd z_diff = Zsig_lidar.col(i) - z_pred_l_;
+    Fixed<2, 1> z_diff = Zsig_lidar.col(i) - z_pred_l_;
 
-    S_l_ = S_l_ + weights_(i) * z_diff * z_diff.transpose();
+    S_l_ = S_l_ + config_.weights_(i) * z_diff * z_diff.transpose();
   }
 
   // add measurement noise covariance matrix
-  MatrixXd R = MatrixXd(n_z_lidar_, n_z_lidar_);
-  R << std_laspx_ * std_laspx_, 0,
-      0, std_laspy_ * std_laspy_;
+  Fixed<2, 2> R;
+  R << config_.std_laspx_ * config_.std_laspx_, 0,
+      0, config_.std_laspy_ * config_.std_laspy_;
 
   S_l_ = S_l_ + R;
 }
-void UKF::UpdateLidar(MeasurementPackage meas_package)
+void UKF::UpdateLidar(const MeasurementPackage &meas_package)
 {
   /**
    * Uses lidar data to update the belief 
@@ -411,38 +451,41 @@ void UKF::UpdateLidar(MeasurementPackage meas_package)
    * You can also calculate the lidar NIS, if desired.
    */
 
-  VectorXd z = VectorXd(n_z_lidar_);
+  Fixed<2, 1> z;
   z << meas_package.raw_measurements_[0], // x position
       meas_package.raw_measurements_[1];  // y position
 
   // create matrix for cross correlation Tc
-  MatrixXd Tc = MatrixXd(n_x_, n_z_lidar_);
+  Fixed<5, 2> Tc;
 
   // calculate cross correlation matrix
   Tc.fill(0.0);
-  for (int i = 0; i < (2 * n_aug_ + 1); ++i)
+  for (int i = 0; i < (2 * config_.n_aug_ + 1); ++i)
   {
     // residual
-    VectorXd z_diff = Zsig_lidar.col(i) - z_pred_l_;
+    Fixed<2, 1> z_diff = Zsig_lidar.col(i) - z_pred_l_;
 
     // state difference
-    VectorXd x_diff = Xsig_pred_.col(i) - x_;
+    StateVector x_diff = Xsig_pred_.col(i) - state_.x_;
 
-    Tc = Tc + weights_(i) * x_diff * z_diff.transpose();
+    Tc = Tc + config_.weights_(i) * x_diff * z_diff.transpose();
   }
 
   // Kalman gain K;
-  MatrixXd K = Tc * S_l_.inverse();
+  Fixed<2, 2> S_inv = S_l_.inverse();
+  Fixed<5, 2> K = Tc * S_inv;
 
   // residual
-  VectorXd z_diff = z - z_pred_l_;
+  Fixed<2, 1> z_diff = z - z_pred_l_;
 
   // update state mean and covariance matrix
-  x_ = x_ + K * z_diff;
-  P_ = P_ - K * S_l_ * K.transpose();
+  state_.x_ = state_.x_ + K * z_diff;
+  state_.P_ = state_.P_ - K * S_l_ * K.transpose();
+
+  state_.nis_ = z_diff.transpose() * S_inv * z_diff;
 }
 
-void UKF::UpdateRadar(MeasurementPackage meas_package)
+void UKF::UpdateRadar(const MeasurementPackage &meas_package)
 {
   /**
    * Uses radar data to update the belief 
@@ -452,7 +495,7 @@ void UKF::UpdateRadar(MeasurementPackage meas_package)
    */
 
   // create vector for incoming radar measurement
-  VectorXd z = VectorXd(n_z_radar_);
+  Fixed<3, 1> z;
   z << meas_package.raw_measurements_[0], // rho in m
       meas_package.raw_measurements_[1],  // phi in rad
       meas_package.raw_measurements_[2];  // rho_dot in m/s
@@ -460,14 +503,14 @@ void UKF::UpdateRadar(MeasurementPackage meas_package)
   // std::cout << "Update state z measurement = " << std::endl << z << std::endl;
 
   // create matrix for cross correlation Tc
-  MatrixXd Tc = MatrixXd(n_x_, n_z_radar_);
+  Fixed<5, 3> Tc;
 
   // calculate cross correlation matrix
   Tc.fill(0.0);
-  for (int i = 0; i < (2 * n_aug_ + 1); ++i)
+  for (int i = 0; i < (2 * config_.n_aug_ + 1); ++i)
   {
     // residual
-    VectorXd z_diff = Zsig_radar.col(i) - z_pred_r_;
+    Fixed<3, 1> z_diff = Zsig_radar.col(i) - z_pred_r_;
 
     // angle normalization
     while (z_diff(1) > M_PI)
@@ -480,7 +523,7 @@ void UKF::UpdateRadar(MeasurementPackage meas_package)
     }
 
     // state difference
-    VectorXd x_diff = Xsig_pred_.col(i) - x_;
+    StateVector x_diff = Xsig_pred_.col(i) - state_.x_;
     // angle normalization
     while (x_diff(3) > M_PI)
     {
@@ -491,14 +534,15 @@ void UKF::UpdateRadar(MeasurementPackage meas_package)
       x_diff(3) += 2. * M_PI;
     }
 
-    Tc = Tc + weights_(i) * x_diff * z_diff.transpose();
+    Tc = Tc + config_.weights_(i) * x_diff * z_diff.transpose();
   }
 
   // Kalman gain K;
-  MatrixXd K = Tc * S_r_.inverse();
+  Fixed<3, 3> S_inv = S_r_.inverse();
+  Fixed<5, 3> K = Tc * S_inv;
 
   // residual
-  VectorXd z_diff = z - z_pred_r_;
+  Fixed<3, 1> z_diff = z - z_pred_r_;
 
   //angle normalization
   while (z_diff(1) > M_PI)
@@ -511,12 +555,187 @@ void UKF::UpdateRadar(MeasurementPackage meas_package)
   }
 
   // update state mean and covariance matrix
-  x_ = x_ + K * z_diff;
-  P_ = P_ - K * S_r_ * K.transpose();
+  state_.x_ = state_.x_ + K * z_diff;
+  state_.P_ = state_.P_ - K * S_r_ * K.transpose();
+
+  // the residual is angle normalized, CalculateNIS would not be
+  state_.nis_ = z_diff.transpose() * S_inv * z_diff;
 }
 
 const float UKF::CalculateNIS(const VectorXd &z_prediction, const VectorXd &z_measurement, const MatrixXd &covariance)
 {
   VectorXd difference{z_measurement - z_prediction};
   return difference.transpose() * covariance.inverse() * difference;
-}
\ No newline at end of file
+}
+
+void UKF::PredictLinear(double delta_t)
+{
+  // white noise acceleration of std_a_ along both axes
+  double dt2 = delta_t * delta_t;
+  double dt3 = dt2 * delta_t / 2;
+  double dt4 = dt2 * dt2 / 4;
+  double var_a = config_.std_a_ * config_.std_a_;
+
+  Eigen::Matrix4d F = Eigen::Matrix4d::Identity();
+  F(0, 2) = delta_t;
+  F(1, 3) = delta_t;
+
+  Eigen::Matrix4d Q;
+  Q << dt4 * var_a, 0, dt3 * var_a, 0,
+      0, dt4 * var_a, 0, dt3 * var_a,
+      dt3 * var_a, 0, dt2 * var_a, 0,
+      0, dt3 * var_a, 0, dt2 * var_a;
+
+  Eigen::Vector4d x = state_.x_cv_;
+  Eigen::Matrix4d P = state_.P_cv_;
+  state_.x_cv_ = F * x;
+  state_.P_cv_ = F * P * F.transpose() + Q;
+}
+
+void UKF::UpdateLidarLinear(const MeasurementPackage &meas_package)
+{
+  Eigen::Vector2d z(meas_package.raw_measurements_[0], meas_package.raw_measurements_[1]);
+  Eigen::Matrix4d P = state_.P_cv_;
+
+  // the measurement is the position, H picks the first two states
+  Eigen::Matrix2d S = P.topLeftCorner<2, 2>();
+  S(0, 0) += config_.std_laspx_ * config_.std_laspx_;
+  S(1, 1) += config_.std_laspy_ * config_.std_laspy_;
+  Eigen::Matrix2d S_inv = S.inverse();
+  Eigen::Matrix<double, 4, 2> K = P.leftCols<2>() * S_inv;
+
+  Eigen::Vector2d z_diff = z - state_.x_cv_.head(2);
+  state_.nis_ = z_diff.transpose() * S_inv * z_diff;
+
+  state_.x_cv_ = state_.x_cv_ + K * z_diff;
+  state_.P_cv_ = P - K * P.topRows<2>();
+}
+
+void UKF::UpdateRadarLinear(const MeasurementPackage &meas_package)
+{
+  Eigen::Vector4d x = state_.x_cv_;
+  Eigen::Matrix4d P = state_.P_cv_;
+  double p_x = x(0);
+  double p_y = x(1);
+  double v1 = x(2);
+  double v2 = x(3);
+
+  double c1 = p_x * p_x + p_y * p_y;
+  if (c1 < 1e-6)
+  {
+    // no bearing at the radar itself, coast
+    state_.nis_ = 0;
+    return;
+  }
+  double c2 = sqrt(c1);
+  double c3 = c1 * c2;
+
+  // predicted measurement and its Jacobian
+  Eigen::Vector3d z_pred(c2, atan2(p_y, p_x), (p_x * v1 + p_y * v2) / c2);
+  Eigen::Matrix<double, 3, 4> H;
+  H << p_x / c2, p_y / c2, 0, 0,
+      -p_y / c1, p_x / c1, 0, 0,
+      p_y * (v1 * p_y - v2 * p_x) / c3, p_x * (v2 * p_x - v1 * p_y) / c3, p_x / c2, p_y / c2;
+
+  Eigen::Vector3d z(meas_package.raw_measurements_[0], meas_package.raw_measurements_[1], meas_package.raw_measurements_[2]);
+  Eigen::Vector3d z_diff = z - z_pred;
+
+  // angle normalization
+  while (z_diff(1) > M_PI)
+  {
+    z_diff(1) -= 2. * M_PI;
+  }
+  while (z_diff(1) < -M_PI)
+  {
+    z_diff(1) += 2. * M_PI;
+  }
+
+  Eigen::Matrix3d S = H * P * H.transpose();
+  S(0, 0) += config_.std_radr_ * config_.std_radr_;
+  S(1, 1) += config_.std_radphi_ * config_.std_radphi_;
+  S(2, 2) += config_.std_radrd_ * config_.std_radrd_;
+  Eigen::Matrix3d S_inv = S.inverse();
+  Eigen::Matrix<double, 4, 3> K = P * H.transpose() * S_inv;
+
+  state_.nis_ = z_diff.transpose() * S_inv * z_diff;
+
+  state_.x_cv_ = x + K * z_diff;
+  state_.P_cv_ = (Eigen::Matrix4d::Identity() - K * H) * P;
+}
+
+void UKF::CTRVToLinear()
+{
+  double v = state_.x_(2);
+  double yaw = state_.x_(3);
+  state_.x_cv_ << state_.x_(0), state_.x_(1), v * cos(yaw), v * sin(yaw);
+
+  // Jacobian of [px py v*cos(yaw) v*sin(yaw)], the yaw rate is dropped
+  Eigen::Matrix<double, 4, 5> J = Eigen::Matrix<double, 4, 5>::Zero();
+  J(0, 0) = 1;
+  J(1, 1) = 1;
+  J(2, 2) = cos(yaw);
+  J(2, 3) = -v * sin(yaw);
+  J(3, 2) = sin(yaw);
+  J(3, 3) = v * cos(yaw);
+  Eigen::Matrix<double, 5, 5> P = state_.P_;
+  state_.P_cv_ = J * P * J.transpose();
+
+  state_.linear_yawd_var_ = state_.P_(4, 4);
+  state_.linear_since_us_ = state_.time_us_;
+  state_.linear_ = true;
+}
+
+void UKF::LinearToCTRV()
+{
+  double v1 = state_.x_cv_(2);
+  double v2 = state_.x_cv_(3);
+
+  // keep the sign of the speed the UKF had, heading follows it
+  double sign = (state_.x_(2) < 0) ? -1 : 1;
+  double speed = sqrt(v1 * v1 + v2 * v2);
+  double yaw = state_.x_(3);
+  if (speed > 0.1)
+  {
+    // nearest to the last heading so the angle doesn't jump by 2 pi
+    yaw = state_.x_(3) + remainder(atan2(sign * v2, sign * v1) - state_.x_(3), 2. * M_PI);
+  }
+  state_.x_ << state_.x_cv_(0), state_.x_cv_(1), sign * speed, yaw, 0;
+
+  // Jacobian of [px py |v| atan2(v2, v1)], kept finite near standstill
+  double s = std::max(speed, 0.1);
+  Eigen::Matrix<double, 5, 4> G = Eigen::Matrix<double, 5, 4>::Zero();
+  G(0, 0) = 1;
+  G(1, 1) = 1;
+  G(2, 2) = sign * v1 / s;
+  G(2, 3) = sign * v2 / s;
+  G(3, 2) = -v2 / (s * s);
+  G(3, 3) = v1 / (s * s);
+  Eigen::Matrix4d P = state_.P_cv_;
+  state_.P_ = G * P * G.transpose();
+
+  // the yaw rate went unobserved since the switch, its variance grew with the yaw acceleration noise
+  state_.P_(4, 4) = state_.linear_yawd_var_ + config_.std_yawdd_ * config_.std_yawdd_ * (state_.time_us_ - state_.linear_since_us_) / 1000000.0;
+}
+
+void UKF::SelectModel(MeasurementPackage::SensorType sensor_type)
+{
+  double gate = (sensor_type == MeasurementPackage::LASER) ? config_.nis_gate_lidar_ : config_.nis_gate_radar_;
+  if (state_.nis_ > gate)
+  {
+    state_.stable_updates_ = 0;
+    ++state_.outliers_;
+    // one outlier in twenty is expected, two in a row is a maneuver, x_ and P_ already hold the CTRV state
+    if (state_.linear_ && state_.outliers_ >= 2)
+    {
+      state_.linear_ = false;
+    }
+    return;
+  }
+
+  state_.outliers_ = 0;
+  ++state_.stable_updates_;
+  if (!state_.linear_ && state_.stable_updates_ >= config_.hybrid_stable_updates_ && fabs(state_.x_(4)) < config_.hybrid_yawd_ && sqrt(state_.P_(4, 4)) < config_.hybrid_yawd_std_)
+  {
+    CTRVToLinear();
+  }
+}
@@ -8,9 +8,145 @@ class UKF
 {
 public:
   /**
-   * Constructor
+   * Fixed size matrices, so an update allocates nothing and a track's state can be
+   * kept in a track pool. DontAlign lets them sit at any address
    */
-  UKF();
+  template <int Rows, int Cols>
+  using Fixed = Eigen::Matrix<double, Rows, Cols, Eigen::DontAlign>;
+  typedef Fixed<5, 1> StateVector;
+  typedef Fixed<5, 5> StateMatrix;
+
+  /**
+   * What a track keeps from one update to the next, written by every update.
+   * A track pool keeps only this per track, the most used values first
+   */
+  struct State
+  {
+    State();
+
+    /**
+     * IsInitialized true once the first measurement has set the state
+     */
+    bool IsInitialized() const { return is_initialized_; }
+
+    /**
+     * IsLinear true while the constant velocity filter is running
+     */
+    bool IsLinear() const { return linear_; }
+
+    // state vector: [pos1 pos2 vel_abs yaw_angle yaw_rate] in SI units and rad
+    StateVector x_;
+
+    // state covariance matrix
+    StateMatrix P_;
+
+    // time when the state is true, in us
+    long long time_us_;
+
+    // NIS of the last update
+    double nis_;
+
+    // initially set to false, set to true in first call of ProcessMeasurement
+    bool is_initialized_;
+
+    // true while the constant velocity filter is running
+    bool linear_;
+
+    // updates in a row whose NIS was within the gate
+    int stable_updates_;
+
+    // updates in a row whose NIS was over the gate
+    int outliers_;
+
+    // yaw rate variance when the linear filter took over, and when that was in us
+    double linear_yawd_var_;
+    long long linear_since_us_;
+
+    // constant velocity state vector: [pos1 pos2 vel1 vel2] in SI units
+    Fixed<4, 1> x_cv_;
+
+    // constant velocity state covariance matrix
+    Fixed<4, 4> P_cv_;
+  };
+
+  /**
+   * Noise, sigma point weights and model switching thresholds. Only read by the
+   * updates, so tracks keep theirs apart from their states
+   */
+  struct Config
+  {
+    Config();
+
+    /**
+     * SetHybrid lets the filter run a linear constant velocity Kalman filter
+     * while the track goes straight, and the UKF while it turns
+     */
+    void SetHybrid(bool hybrid) { use_hybrid_ = hybrid; }
+
+    // if this is false, laser measurements will be ignored (except for init)
+    bool use_laser_;
+
+    // if this is false, radar measurements will be ignored (except for init)
+    bool use_radar_;
+
+    // if this is true, straight tracks run the linear constant velocity filter
+    bool use_hybrid_;
+
+    // Process noise standard deviation longitudinal acceleration in m/s^2
+    double std_a_;
+
+    // Process noise standard deviation yaw acceleration in rad/s^2
+    double std_yawdd_;
+
+    // Laser measurement noise standard deviation position1 in m
+    double std_laspx_;
+
+    // Laser measurement noise standard deviation position2 in m
+    double std_laspy_;
+
+    // Radar measurement noise standard deviation radius in m
+    double std_radr_;
+
+    // Radar measurement noise standard deviation angle in rad
+    double std_radphi_;
+
+    // Radar measurement noise standard deviation radius change in m/s
+    double std_radrd_;
+
+    // Weights of sigma points
+    Fixed<15, 1> weights_;
+
+    // State dimension
+    int n_x_;
+
+    // Measurement dimension radar
+    int n_z_radar_;
+
+    // Measurement dimension lidar
+    int n_z_lidar_;
+
+    // Augmented state dimension
+    int n_aug_;
+
+    // Sigma point spreading parameter
+    double lambda_;
+
+    // tracks with a yaw rate below this in rad/s and a yaw rate standard deviation
+    // below hybrid_yawd_std_ go linear after hybrid_stable_updates_ stable updates
+    double hybrid_yawd_;
+    double hybrid_yawd_std_;
+    int hybrid_stable_updates_;
+
+    // NIS gates, chi square with 2 and 3 degrees of freedom at 95%
+    double nis_gate_lidar_;
+    double nis_gate_radar_;
+  };
+
+  /**
+   * Constructor, runs the filter on a track's state with the track's configuration.
+   * Only holds the scratch of the updates, make one where the update runs
+   */
+  UKF(State &state, const Config &config);
 
   /**
    * Destructor
@@ -21,7 +157,7 @@ public:
    * ProcessMeasurement
    * @param meas_package The latest measurement data of either radar or laser
    */
-  void ProcessMeasurement(MeasurementPackage meas_package);
+  void ProcessMeasurement(const MeasurementPackage &meas_package);
 
   /**
    * Prediction Predicts sigma points, the state, and the state covariance
@@ -30,107 +166,74 @@ public:
    */
   void Prediction(double delta_t);
 
-  // state vector: [pos1 pos2 vel_abs yaw_angle yaw_rate] in SI units and rad
-  Eigen::VectorXd x_;
-
 private:
   /**
-   * Called when receiveing first measurement. Initializes P, x, and weights
+   * Called when receiveing first measurement. Initializes P and x
    */
-  void InitializeUKF(MeasurementPackage meas_package);
+  void InitializeUKF(const MeasurementPackage &meas_package);
 
   /**
    * Updates the state and the state covariance matrix using a laser measurement
    * @param meas_package The measurement at k+1
    */
-  void UpdateLidar(MeasurementPackage meas_package);
+  void UpdateLidar(const MeasurementPackage &meas_package);
 
   /**
    * Updates the state and the state covariance matrix using a radar measurement
    * @param meas_package The measurement at k+1
    */
-  void UpdateRadar(MeasurementPackage meas_package);
+  void UpdateRadar(const MeasurementPackage &meas_package);
 
-  // initially set to false, set to true in first call of ProcessMeasurement
-  bool is_initialized_;
+  /**
+   * Constant velocity counterparts of Prediction, UpdateLidar and UpdateRadar
+   * on x_cv_ and P_cv_, radar is linearized around the prediction
+   */
+  void PredictLinear(double delta_t);
+  void UpdateLidarLinear(const MeasurementPackage &meas_package);
+  void UpdateRadarLinear(const MeasurementPackage &meas_package);
 
-  // if this is false, laser measurements will be ignored (except for init)
-  bool use_laser_;
+  /**
+   * Convert the state and covariance between the CTRV model and the constant
+   * velocity model with the Jacobians of the conversion
+   */
+  void CTRVToLinear();
+  void LinearToCTRV();
 
-  // if this is false, radar measurements will be ignored (except for init)
-  bool use_radar_;
+  /**
+   * Switches between the two models after an update, from the yaw rate and the NIS
+   * @param sensor_type The sensor of the update
+   */
+  void SelectModel(MeasurementPackage::SensorType sensor_type);
 
-  // state covariance matrix
-  Eigen::MatrixXd P_;
+  // the track being updated
+  State &state_;
+  const Config &config_;
 
-  // Initial sigma point matrix
-  Eigen::MatrixXd Xsig_;
+  // scratch of one update, from the prediction to the end of the update
 
   // Augmented sigma point matrix
-  Eigen::MatrixXd Xsig_aug_;
+  Fixed<7, 15> Xsig_aug_;
 
   // Predicted sigma points matrix
-  Eigen::MatrixXd Xsig_pred_;
-
-  // time when the state is true, in us
-  long long time_us_;
-
-  // Process noise standard deviation longitudinal acceleration in m/s^2
-  double std_a_;
-
-  // Process noise standard deviation yaw acceleration in rad/s^2
-  double std_yawdd_;
-
-  // Laser measurement noise standard deviation position1 in m
-  double std_laspx_;
-
-  // Laser measurement noise standard deviation position2 in m
-  double std_laspy_;
-
-  // Radar measurement noise standard deviation radius in m
-  double std_radr_;
-
-  // Radar measurement noise standard deviation angle in rad
-  double std_radphi_;
-
-  // Radar measurement noise standard deviation radius change in m/s
-  double std_radrd_;
-
-  // Weights of sigma points
-  Eigen::VectorXd weights_;
-
-  // State dimension
-  int n_x_;
-
-  // Measurement dimension radar
-  int n_z_radar_;
-
-  // Measurement dimension lidar
-  int n_z_lidar_;
+  Fixed<5, 15> Xsig_pred_;
 
   // mean predicted measurement vector radar
-  Eigen::VectorXd z_pred_r_;
+  Fixed<3, 1> z_pred_r_;
 
   // measurement covariance matrix S radar
-  Eigen::MatrixXd S_r_;
+  Fixed<3, 3> S_r_;
 
   // sigma point matrix in radar measurement dimension
-  Eigen::MatrixXd Zsig_radar;
+  Fixed<3, 15> Zsig_radar;
 
   // sigma point matrix in lidar measurement dimension
-  Eigen::MatrixXd Zsig_lidar;
+  Fixed<2, 15> Zsig_lidar;
 
   // mean predicted measurement vector lidar
-  Eigen::VectorXd z_pred_l_;
+  Fixed<2, 1> z_pred_l_;
 
   // measurement covariance matrix S lidar
-  Eigen::MatrixXd S_l_;
-
-  // Augmented state dimension
-  int n_aug_;
-
-  // Sigma point spreading parameter
-  double lambda_;
+  Fixed<2, 2> S_l_;
 
   void GenerateAugmentedSigmaPoints();
   void SigmaPointPrediction(double delta_t);
@@ -138,7 +241,7 @@ private:
   void PredictRadarMeasurement();
   void PredictLidarMeasurement();
 
-  const float UKF::CalculateNIS(const VectorXd &z_prediction, const VectorXd &z_measurement, const MatrixXd &covariance);
+  const float CalculateNIS(const Eigen::VectorXd &z_prediction, const Eigen::VectorXd &z_measurement, const Eigen::MatrixXd &covariance);
 };
 
-#endif // UKF_H
\ No newline at end of file
+#endif // UKF_H